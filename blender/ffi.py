@@ -48,6 +48,130 @@ def initialize():
         native.audionodes_initialize()
         flag_initialized = True
 
+native.audionodes_initialize_offline.argtypes = []
+native.audionodes_initialize_offline.restype = None
+def initialize_offline():
+    global flag_initialized
+    if not flag_initialized:
+        native.audionodes_initialize_offline()
+        flag_initialized = True
+
+native.audionodes_render.argtypes = [ct.POINTER(ct.c_float), ct.c_size_t]
+native.audionodes_render.restype = ct.c_size_t
+def render(samples):
+    buf = (ct.c_float * samples)()
+    written = native.audionodes_render(buf, samples)
+    return buf[:written]
+
+native.audionodes_render_to_file.argtypes = [ct.c_char_p, ct.c_double]
+native.audionodes_render_to_file.restype = ct.c_bool
+def render_to_file(path, seconds):
+    return native.audionodes_render_to_file(path, seconds)
+
+native.audionodes_set_sample_rate.argtypes = [ct.c_int]
+native.audionodes_set_sample_rate.restype = ct.c_bool
+def set_sample_rate(rate):
+    return native.audionodes_set_sample_rate(rate)
+
+native.audionodes_get_sample_rate.argtypes = []
+native.audionodes_get_sample_rate.restype = ct.c_int
+def get_sample_rate():
+    return native.audionodes_get_sample_rate()
+
+native.audionodes_set_block_size.argtypes = [ct.c_size_t]
+native.audionodes_set_block_size.restype = ct.c_bool
+def set_block_size(size):
+    return native.audionodes_set_block_size(size)
+
+native.audionodes_get_block_size.argtypes = []
+native.audionodes_get_block_size.restype = ct.c_size_t
+def get_block_size():
+    return native.audionodes_get_block_size()
+
+native.audionodes_set_voice_lanes.argtypes = [ct.c_size_t]
+native.audionodes_set_voice_lanes.restype = ct.c_bool
+def set_voice_lanes(lanes):
+    return native.audionodes_set_voice_lanes(lanes)
+
+native.audionodes_get_voice_lanes.argtypes = []
+native.audionodes_get_voice_lanes.restype = ct.c_size_t
+def get_voice_lanes():
+    return native.audionodes_get_voice_lanes()
+
+native.audionodes_get_output_latency.argtypes = []
+native.audionodes_get_output_latency.restype = ct.c_size_t
+def get_output_latency():
+    return native.audionodes_get_output_latency()
+
+native.audionodes_set_render_ahead.argtypes = [ct.c_size_t]
+native.audionodes_set_render_ahead.restype = None
+def set_render_ahead(chunks):
+    native.audionodes_set_render_ahead(chunks)
+
+native.audionodes_get_xrun_count.argtypes = []
+native.audionodes_get_xrun_count.restype = ct.c_size_t
+def get_xrun_count():
+    return native.audionodes_get_xrun_count()
+
+native.audionodes_get_engine_health.argtypes = [ct.POINTER(ct.c_size_t)]*5
+native.audionodes_get_engine_health.restype = None
+native.audionodes_get_callback_histogram.argtypes = [ct.POINTER(ct.c_size_t), ct.c_size_t]
+native.audionodes_get_callback_histogram.restype = ct.c_size_t
+def get_engine_health():
+    names = ("overruns", "xruns", "queue_high_water", "dropped_messages", "midi_overflows")
+    values = [ct.c_size_t() for _ in names]
+    native.audionodes_get_engine_health(*map(ct.byref, values))
+    health = dict(zip(names, (v.value for v in values)))
+    size = native.audionodes_get_callback_histogram(None, 0)
+    buckets = (ct.c_size_t * size)()
+    native.audionodes_get_callback_histogram(buckets, size)
+    health["callback_histogram"] = list(buckets)
+    return health
+
+native.audionodes_reset_engine_health.argtypes = []
+native.audionodes_reset_engine_health.restype = None
+def reset_engine_health():
+    native.audionodes_reset_engine_health()
+
+native.audionodes_get_node_timing.argtypes = [ct.c_int, ct.POINTER(ct.c_size_t)] + [ct.POINTER(ct.c_double)]*4 + [ct.POINTER(ct.c_size_t)]
+native.audionodes_get_node_timing.restype = ct.c_bool
+def get_node_timing(node_id):
+    count, voices = ct.c_size_t(), ct.c_size_t()
+    values = [ct.c_double() for _ in range(4)]
+    if not native.audionodes_get_node_timing(node_id, ct.byref(count), *map(ct.byref, values), ct.byref(voices)):
+        return None
+    timing = dict(zip(("min", "mean", "max", "p99"), (v.value for v in values)))
+    timing["count"] = count.value
+    timing["voices"] = voices.value
+    return timing
+
+native.audionodes_reset_node_timing.argtypes = []
+native.audionodes_reset_node_timing.restype = None
+def reset_node_timing():
+    native.audionodes_reset_node_timing()
+
+native.audionodes_set_worker_threads.argtypes = [ct.c_size_t]
+native.audionodes_set_worker_threads.restype = None
+def set_worker_threads(amount):
+    native.audionodes_set_worker_threads(amount)
+
+native.audionodes_set_voice_parallelism.argtypes = [ct.c_size_t]
+native.audionodes_set_voice_parallelism.restype = None
+def set_voice_parallelism(min_voices):
+    native.audionodes_set_voice_parallelism(min_voices)
+
+native.audionodes_set_pipeline_stages.argtypes = [ct.c_size_t]
+native.audionodes_set_pipeline_stages.restype = None
+def set_pipeline_stages(stages):
+    native.audionodes_set_pipeline_stages(stages)
+
+native.audionodes_get_control_stats.argtypes = [ct.POINTER(ct.c_size_t), ct.POINTER(ct.c_size_t)]
+native.audionodes_get_control_stats.restype = None
+def get_control_stats():
+    coalesced, dropped = ct.c_size_t(), ct.c_size_t()
+    native.audionodes_get_control_stats(ct.byref(coalesced), ct.byref(dropped))
+    return coalesced.value, dropped.value
+
 native.audionodes_cleanup.argtypes = []
 native.audionodes_cleanup.restype = None
 def cleanup():
@@ -102,6 +226,41 @@ def add_tree_update_link(ref, from_node, to_node, from_socket, to_socket):
     native.audionodes_add_tree_update_link(ref, from_node, to_node, from_socket, to_socket)
 
 native.audionodes_finish_tree_update.argtypes = [ct.c_void_p]
-native.audionodes_finish_tree_update.restype = None
+native.audionodes_finish_tree_update.restype = ct.c_bool
 def finish_tree_update(ref):
-    native.audionodes_finish_tree_update(ref)
+    return native.audionodes_finish_tree_update(ref)
+
+native.audionodes_begin_graph_edit.argtypes = []
+native.audionodes_begin_graph_edit.restype = None
+def begin_graph_edit():
+    native.audionodes_begin_graph_edit()
+
+native.audionodes_end_graph_edit.argtypes = []
+native.audionodes_end_graph_edit.restype = None
+def end_graph_edit():
+    native.audionodes_end_graph_edit()
+
+native.audionodes_add_link.argtypes = [ct.c_int, ct.c_int, ct.c_size_t, ct.c_size_t]
+native.audionodes_add_link.restype = ct.c_bool
+def add_link(from_node, to_node, from_socket, to_socket):
+    return native.audionodes_add_link(from_node, to_node, from_socket, to_socket)
+
+native.audionodes_remove_link.argtypes = [ct.c_int, ct.c_int, ct.c_size_t, ct.c_size_t]
+native.audionodes_remove_link.restype = ct.c_bool
+def remove_link(from_node, to_node, from_socket, to_socket):
+    return native.audionodes_remove_link(from_node, to_node, from_socket, to_socket)
+
+native.audionodes_save_graph.argtypes = [ct.c_char_p]
+native.audionodes_save_graph.restype = ct.c_bool
+def save_graph(path):
+    return native.audionodes_save_graph(path)
+
+native.audionodes_load_graph.argtypes = [ct.c_char_p]
+native.audionodes_load_graph.restype = ct.c_bool
+def load_graph(path):
+    return native.audionodes_load_graph(path)
+
+native.audionodes_replace_node.argtypes = [ct.c_int, ct.c_int]
+native.audionodes_replace_node.restype = ct.c_bool
+def replace_node(old_id, new_id):
+    return native.audionodes_replace_node(old_id, new_id)
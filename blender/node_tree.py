@@ -21,7 +21,7 @@ class AudioTree(NodeTree):
         # don't do anything in that case
         if ffi.flag_loading_file:
             return
-        links = ffi.begin_tree_update()
+        links = set()
         for link in self.links:
             if link.to_node.bl_idname == "NodeReroute":
                 continue
@@ -38,15 +38,38 @@ class AudioTree(NodeTree):
                 continue
             from_node.check_revive()
             to_node.check_revive()
-            ffi.add_tree_update_link(links, from_node.get_uid(), to_node.get_uid(), from_socket.get_index(), to_socket.get_index())
-        ffi.finish_tree_update(links)
+            links.add((from_node.get_uid(), to_node.get_uid(), from_socket.get_index(), to_socket.get_index()))
+        key = self.as_pointer()
+        if key not in sent_links:
+            # Nothing known about the native side, send the full list
+            ref = ffi.begin_tree_update()
+            for link in links:
+                ffi.add_tree_update_link(ref, *link)
+            if ffi.finish_tree_update(ref):
+                sent_links[key] = links
+            return
+        # Only send what changed, published once at the end
+        sent = sent_links[key]
+        ffi.begin_graph_edit()
+        for link in sent - links:
+            if ffi.node_exists(link[0]) and ffi.node_exists(link[1]):
+                ffi.remove_link(*link)
+            sent.discard(link)
+        for link in links - sent:
+            if ffi.add_link(*link):
+                sent.add(link)
+        ffi.end_graph_edit()
 
     def post_load_handler(self):
+        # Nodes get new ids from reinit
+        sent_links.pop(self.as_pointer(), None)
         for node in self.nodes:
             if isinstance(node, AudioTreeNode):
                 node.reinit()
         self.update()
 
+# Links last sent to the native side, by tree
+sent_links = {}
 
 # Custom socket type
 class AudioTreeNodeSocket:
@@ -207,6 +230,7 @@ class Math(Node, AudioTreeNode):
 
     def change_func(self, context):
         self.send_property_update(0, self.func_enum_to_native[self.func_enum])
+        self.send_property_update(1, self.precision_enum_to_native[self.precision_enum])
 
     def reinit(self):
         AudioTreeNode.reinit(self)
@@ -241,6 +265,19 @@ class Math(Node, AudioTreeNode):
         update = change_func
     )
 
+    # Fast evaluates the functions with SIMD approximations
+    precision_enum_items = [
+        ('PRECISE', 'Precise', '', 0),
+        ('FAST', 'Fast', '', 1)
+    ]
+
+    precision_enum_to_native = { item[0]: item[3] for item in precision_enum_items }
+
+    precision_enum = bpy.props.EnumProperty(
+        items = precision_enum_items,
+        update = change_func
+    )
+
     def init(self, context):
         AudioTreeNode.init(self, context)
         self.inputs.new('RawAudioSocketType', "Audio")
@@ -249,6 +286,7 @@ class Math(Node, AudioTreeNode):
 
     def draw_buttons(self, context, layout):
         layout.prop(self, 'func_enum', text='')
+        layout.prop(self, 'precision_enum', text='')
 
 class MidiIn(Node, AudioTreeNode):
     bl_idname = 'MidiInNode'
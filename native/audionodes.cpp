@@ -1,4 +1,5 @@
 #include "audionodes.hpp"
+#include "util/kernels.hpp"
 
 namespace audionodes {
 
@@ -8,14 +9,37 @@ NodeTypeMap& get_node_types() {
   return node_types;
 }
 
-// Nodes addressed by unique integers
-std::map<node_uid, Node*> node_storage;
-node_uid node_storage_counter = 0;
-node_uid node_storage_alloc() {
-  return node_storage_counter++;
+int RATE = DEFAULT_RATE;
+// Rate asked for through audionodes_set_sample_rate, 0 to follow the device
+int requested_rate = DEFAULT_RATE;
+size_t BLOCK_SIZE = DEFAULT_BLOCK_SIZE;
+size_t VOICE_LANES = 0;
+
+// Nodes addressed by generational handles, along with what saving
+// a graph needs that the nodes don't keep themselves
+struct StoredNode {
+  Node *node = nullptr;
+  std::string type;
+  // Latest payload sent to each slot, shared with copies of the node
+  std::map<int, std::shared_ptr<const std::vector<char>>> binaries;
+};
+SlotMap<StoredNode> node_storage;
+
+// nullptr for removed (stale) and invalid ids
+Node* find_node(node_uid id) {
+  StoredNode *stored = node_storage.find(id);
+  return stored ? stored->node : nullptr;
 }
 
-NodeTree *main_node_tree;
+// Published to the execution thread without locking, replaced objects are
+// deleted through the reclaimer once the execution thread is done with them
+std::atomic<NodeTree*> main_node_tree(nullptr);
+// Optional pool for evaluating independent nodes in parallel
+std::atomic<WorkerPool*> worker_pool(nullptr);
+EpochReclaimer reclaimer;
+size_t min_parallel_voices = 0;
+// Pipeline stages of the published trees, see NodeTree
+size_t pipeline_stages = 1;
 
 Message::Message() {}
 Message::Message(Node* node, size_t slot, float audio_input) :
@@ -43,63 +67,252 @@ void Message::apply() {
 }
 
 CircularBuffer<Message, 256> msg_queue;
+ControlChannel control_channel;
+
+void reclaim_retired();
 
 void send_message(Message msg) {
+  // The node may have become free for direct access since the last publish
+  if (msg.node->_pending_disconnect) reclaim_retired();
   if (msg.node->mark_connected) {
     // Node is connected and actively used by the execution thread, use thread-safe communication
-    // Sleep until queue has room
-    for (size_t rep = 0; rep < 10 && msg_queue.full(); ++rep) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(1000*N/RATE+1));
+    switch (msg.type) {
+      case Message::Type::audio_input:
+        if (!control_channel.send_input(msg.node, msg.slot, msg.audio_input)) {
+          get_engine_health().record_dropped_message();
+        }
+        get_engine_health().record_queue_depth(control_channel.get_queue_depth());
+        return;
+      case Message::Type::property:
+        if (!control_channel.send_property(msg.node, msg.slot, msg.property)) {
+          get_engine_health().record_dropped_message();
+        }
+        get_engine_health().record_queue_depth(control_channel.get_queue_depth());
+        return;
+      case Message::Type::binary:
+        break;
     }
-    // Fail
+    // Binary data can't be coalesced, but never wait for the queue either
     if (msg_queue.full()) {
       std::cerr << "Audionodes native: Unable to communicate with execution thread" << std::endl;
-      if (msg.type == Message::Type::binary) {
-        char *ptr = (char*) msg.binary;
-        delete [] ptr;
-      }
+      char *ptr = (char*) msg.binary;
+      delete [] ptr;
+      get_engine_health().record_dropped_message();
       return;
     }
     msg_queue.push(msg);
+    get_engine_health().record_queue_depth(msg_queue.size());
   } else {
     // Apply the message directly
+    // An update queued while the node was still connected may be applied
+    // later on, make sure it carries the latest value
+    if (msg.type == Message::Type::audio_input) {
+      msg.node->pending_input_values[msg.slot].value = msg.audio_input;
+    } else if (msg.type == Message::Type::property) {
+      msg.node->pending_property_values[msg.slot].value = msg.property;
+    }
     msg.apply();
   }
 }
 
+// Returned in place of a result when there is no tree to evaluate
+const Chunk silent_chunk = {};
+
+// Apply pending messages and compute the next chunk of output,
+// shared by the audio device callback and offline rendering
+void evaluate_chunk(Chunk &result) {
+  uint64_t epoch = reclaimer.enter();
+  NodeTree *tree = main_node_tree.load();
+  if (tree == nullptr) {
+    result = silent_chunk;
+  } else {
+    control_channel.apply_pending();
+    while (!msg_queue.empty()) {
+      Message msg = msg_queue.pop();
+      msg.apply();
+    }
+    // Copied out before leaving the epoch, the tree may be deleted after that
+    result = tree->evaluate(worker_pool.load());
+  }
+  reclaimer.exit(epoch);
+}
+
+// Adapter between the engine blocks and whatever amounts the consumer
+// (device callback or audionodes_render) asks for: the part of the last
+// evaluated chunk not yet handed out is carried over to the next call
+Chunk leftover;
+size_t leftover_amount = 0;
+
+// Optional look-ahead rendering, only replaced while the device is locked
+RenderThread *render_thread = nullptr;
+
+void pull_samples(SigT *buffer, size_t samples) {
+  size_t written = 0;
+  while (written < samples) {
+    if (leftover_amount == 0) {
+      if (render_thread) {
+        if (!render_thread->pop(leftover) && render_thread->is_primed()) {
+          get_engine_health().record_xrun();
+        }
+      } else {
+        evaluate_chunk(leftover);
+      }
+      leftover_amount = BLOCK_SIZE;
+    }
+    size_t amount = std::min(samples-written, leftover_amount);
+    std::copy_n(leftover.begin()+BLOCK_SIZE-leftover_amount, amount, buffer+written);
+    leftover_amount -= amount;
+    written += amount;
+  }
+}
+
 void audio_callback(void *userdata, Uint8 *_stream, int len) {
+  auto start = std::chrono::steady_clock::now();
   // Cast byte stream into 16-bit signed int stream
   Sint16 *stream = (Sint16*) _stream;
   len /= 2;
-  if (len != N) {
-    // Horrible failure
-    std::cerr << "Audionodes native: Unexpected sample count: " << len << std::endl;
-    return;
+  Chunk result;
+  // The device buffer may be of any size, convert at most a chunk at a time
+  for (size_t offset = 0; offset < size_t(len); offset += BLOCK_SIZE) {
+    size_t amount = std::min(BLOCK_SIZE, len-offset);
+    pull_samples(result.data(), amount);
+    kernels::clamp_to_int16(result.data(), stream+offset, amount);
   }
-  if (main_node_tree == nullptr) {
-    for (int i = 0; i < len; ++i) stream[i] = 0;
-    return;
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now()-start;
+  get_engine_health().record_callback(elapsed.count()*RATE/len);
+}
+
+SDL_AudioDeviceID dev = 0;
+bool initialized = false;
+// Headless mode: no audio device is opened and chunks are only
+// evaluated on demand by audionodes_render (faster than realtime)
+bool offline = false;
+// Buffer size the device was opened with
+size_t device_samples = 0;
+
+// Free retired trees, nodes and pools the execution thread is done with
+void reclaim_retired() {
+  if (dev == 0 && !offline) {
+    // No execution thread at all
+    reclaimer.reclaim_all();
+  } else {
+    reclaimer.reclaim();
   }
-  while (!msg_queue.empty()) {
-    Message msg = msg_queue.pop();
-    msg.apply();
+}
+
+// Persistent link structure, only changed by deltas
+NodeGraph node_graph;
+// Set by changes the published tree doesn't reflect yet
+bool graph_changed = false;
+// Nesting depth of audionodes_begin_graph_edit, publishing waits for the
+// outermost end
+size_t graph_edit_depth = 0;
+
+void publish_graph();
+
+// Publish a change at once unless inside a batch of edits
+void graph_edited() {
+  graph_changed = true;
+  if (graph_edit_depth == 0) publish_graph();
+}
+
+// Build a NodeTree out of node_graph and hand it to the execution thread,
+// nodes marked for deletion are removed in the process
+void publish_graph() {
+  graph_changed = false;
+  std::vector<node_uid> marked_for_deletion;
+  // Will contain all nodes that need to be evaluated (directly or indirectly connected to a sink)
+  std::unordered_set<node_uid> to_process(node_storage.size());
+  std::vector<node_uid> to_process_q;
+  node_storage.for_each([&](node_uid id, StoredNode &stored) {
+    if (stored.node->mark_deletion) {
+      marked_for_deletion.push_back(id);
+      node_graph.remove_node(id);
+    } else if (stored.node->get_is_sink()) {
+      to_process.insert(id);
+      to_process_q.push_back(id);
+    }
+  });
+  for (size_t i = 0; i < to_process_q.size(); ++i) {
+    for (auto link : node_graph.get_links_to(to_process_q[i])) {
+      if (to_process.count(link.from_node)) continue;
+      to_process.insert(link.from_node);
+      to_process_q.push_back(link.from_node);
+    }
   }
-  constexpr Sint16 maximum_value = (1 << 15)-1;
-  constexpr Sint16 minimum_value = -(1 << 15);
-  const Chunk &result = main_node_tree->evaluate();
-  for (int i = 0; i < len; ++i) {
-    if (result[i] < -1) {
-      stream[i] = minimum_value;
-    } else if (result[i] >= 1) {
-      stream[i] = maximum_value;
-    } else {
-      stream[i] = result[i] * maximum_value;
+
+  // The graph maintains a topological order, only filter it
+  std::vector<Node*> final_order;
+  std::vector<std::vector<NodeTree::Link>> final_links;
+  std::unordered_map<node_uid, size_t> node_index(to_process.size());
+  final_order.reserve(to_process.size());
+  final_links.reserve(to_process.size());
+  for (node_uid id : node_graph.get_order()) {
+    if (!to_process.count(id)) continue;
+    node_index[id] = final_order.size();
+    Node *node = node_storage[id].node;
+    final_order.push_back(node);
+    std::vector<NodeTree::Link> node_links(node->get_input_count());
+    for (auto link : node_graph.get_links_to(id)) {
+      node_links[link.to_socket] = NodeTree::Link(true, node_index[link.from_node], link.from_socket);
     }
+    final_links.push_back(std::move(node_links));
   }
+
+  // Call callbacks on newly connected nodes
+  for (Node *node : final_order) {
+    if (!node->mark_connected) {
+      node->mark_connected = true;
+      node->connect_callback();
+    }
+    // Connected again before a disconnection went through
+    node->_pending_disconnect = 0;
+    node->_tmp_connected = true;
+  }
+
+  // Nodes with an unchanged upstream keep their state from the current tree
+  // (only this thread publishes, so the current tree stays alive here)
+  NodeTree *new_node_tree = new NodeTree(std::move(final_order), std::move(final_links), main_node_tree.load(), pipeline_stages);
+  // Publish the new tree, the execution thread picks it up on its next pass
+  reclaimer.retire(main_node_tree.exchange(new_node_tree));
+
+  // Newly disconnected nodes may still be evaluated by the old tree, so
+  // they keep receiving messages through the execution thread until the
+  // reclaimer is done with it. A later tree may connect them again before
+  // that, which cancels the disconnection.
+  static uint64_t disconnect_counter = 0;
+  node_storage.for_each([](node_uid, StoredNode &stored) {
+    Node *node = stored.node;
+    if (!node->_tmp_connected && node->mark_connected && !node->_pending_disconnect) {
+      uint64_t request = ++disconnect_counter;
+      node->_pending_disconnect = request;
+      reclaimer.retire([node, request]() {
+        if (node->_pending_disconnect != request) return;
+        node->_pending_disconnect = 0;
+        node->mark_connected = false;
+        node->disconnect_callback();
+      });
+    }
+    node->_tmp_connected = false;
+  });
+
+  // Lastly, we clean up the removed nodes
+  // (the old tree may still be evaluating them)
+  for (node_uid id : marked_for_deletion) {
+    reclaimer.retire(node_storage[id].node);
+    node_storage.erase(id);
+  }
+  reclaim_retired();
 }
 
-SDL_AudioDeviceID dev;
-bool initialized = false;
+// Keeps the payload and sends the node a buffer of its own (the node
+// deletes it once consumed)
+void send_binary(StoredNode &stored, int slot, std::shared_ptr<const std::vector<char>> payload) {
+  stored.binaries[slot] = payload;
+  char *bin = new char[payload->size()];
+  std::copy(payload->begin(), payload->end(), bin);
+  send_message(Message(stored.node, slot, payload->size(), bin));
+}
 
 // Methods to be used through the FFI
 extern "C" {
@@ -115,49 +328,273 @@ extern "C" {
     SDL_Init(SDL_INIT_AUDIO);
 
     SDL_AudioSpec spec;
-    spec.freq     = RATE;
+    spec.freq     = requested_rate ? requested_rate : DEFAULT_RATE;
     spec.format   = AUDIO_S16SYS;
     spec.channels = 1;
-    spec.samples  = N;
+    spec.samples  = BLOCK_SIZE;
     spec.callback = audio_callback;
     spec.userdata = nullptr;
     SDL_AudioSpec obtainedSpec;
-    dev = SDL_OpenAudioDevice(NULL, 0, &spec, &obtainedSpec, 0);
+    // The buffer size is adapted to in the callback, so any size is fine.
+    // Without a requested rate, run at whatever the device prefers (no resampling)
+    int allowed_changes = SDL_AUDIO_ALLOW_SAMPLES_CHANGE;
+    if (!requested_rate) allowed_changes |= SDL_AUDIO_ALLOW_FREQUENCY_CHANGE;
+    dev = SDL_OpenAudioDevice(NULL, 0, &spec, &obtainedSpec, allowed_changes);
     if (dev == 0) {
       std::cerr << "Audionides Native: Unable to open audio device: " << SDL_GetError() << std::endl;
       return;
     }
-    if (obtainedSpec.samples == N/2) {
-      // The sample rate gets halved on some systems for some reason
-      // -> correct for that
-      std::cerr << "Audionodes Native: SDL halved sample rate... trying to correct" << std::endl;
-      SDL_CloseAudioDevice(dev);
-      spec.samples = 2*N;
-      obtainedSpec = SDL_AudioSpec();
-      dev = SDL_OpenAudioDevice(NULL, 0, &spec, &obtainedSpec, 0);
-      if (obtainedSpec.samples != N || dev == 0) {
-        std::cerr << "Audionodes Native: Halving correction failed " << SDL_GetError() << std::endl;
-        return;
-      }
-    }
+    device_samples = obtainedSpec.samples;
+    leftover_amount = 0;
+    RATE = requested_rate ? requested_rate : obtainedSpec.freq;
+    offline = false;
+    initialized = true;
     SDL_PauseAudioDevice(dev, 0);
   }
 
-  void audionodes_cleanup() {
-    SDL_CloseAudioDevice(dev);
-    for (auto &id_node_pair : node_storage) {
-      delete id_node_pair.second;
+  void audionodes_initialize_offline() {
+    RATE = requested_rate ? requested_rate : DEFAULT_RATE;
+    offline = true;
+    initialized = true;
+    leftover_amount = 0;
+  }
+
+  size_t audionodes_render(float *buffer, size_t samples) {
+    if (!offline) {
+      std::cerr << "Audionodes native: Rendering requires offline mode" << std::endl;
+      return 0;
+    }
+    pull_samples(buffer, samples);
+    return samples;
+  }
+
+  bool audionodes_render_to_file(const char *path, double seconds) {
+    if (!offline) {
+      std::cerr << "Audionodes native: Rendering requires offline mode" << std::endl;
+      return false;
+    }
+    WavWriter writer(path, RATE);
+    if (!writer.good()) {
+      std::cerr << "Audionodes native: Unable to open \"" << path << "\" for writing" << std::endl;
+      return false;
+    }
+    size_t remaining = std::max(0., seconds*RATE);
+    std::array<float, N> buffer;
+    // Drop the blocks a freshly built pipeline is still filling up with,
+    // along with what was left over from before them
+    NodeTree *tree = main_node_tree.load();
+    size_t unfilled = tree ? tree->get_unfilled_blocks() : 0;
+    size_t skip = unfilled ? leftover_amount + unfilled*BLOCK_SIZE : 0;
+    while (skip > 0) {
+      skip -= audionodes_render(buffer.data(), std::min(skip, BLOCK_SIZE));
+    }
+    while (remaining > 0) {
+      size_t amount = audionodes_render(buffer.data(), std::min(remaining, BLOCK_SIZE));
+      writer.write(buffer.data(), amount);
+      remaining -= amount;
+    }
+    return writer.close();
+  }
+
+  size_t audionodes_get_output_latency() {
+    // Samples can wait in the adapter for up to a chunk, minus the
+    // granularity the device and chunk sizes have in common
+    if (device_samples == 0) return 0;
+    size_t common = device_samples, other = BLOCK_SIZE;
+    while (other != 0) {
+      std::swap(common, other);
+      other %= common;
     }
+    size_t look_ahead = render_thread ? render_thread->get_look_ahead()*BLOCK_SIZE : 0;
+    NodeTree *tree = main_node_tree.load();
+    size_t pipeline = tree ? tree->get_pipeline_delay()*BLOCK_SIZE : 0;
+    return device_samples + BLOCK_SIZE - common + look_ahead + pipeline;
+  }
+
+  void audionodes_set_render_ahead(size_t chunks) {
+    if (dev == 0) {
+      std::cerr << "Audionodes native: Render ahead requires an open audio device" << std::endl;
+      return;
+    }
+    // Only one thread may evaluate at a time (the epoch reclaimer expects a
+    // single reader): the old thread is done before anyone else evaluates,
+    // the callback keeps draining its queue meanwhile
+    RenderThread *old_thread = render_thread;
+    if (old_thread) old_thread->stop();
+    RenderThread *new_thread = chunks > 0 ? new RenderThread(chunks, evaluate_chunk) : nullptr;
+    // The callback doesn't run while locked and only pops from the new
+    // thread once unlocked
+    SDL_LockAudioDevice(dev);
+    render_thread = new_thread;
+    if (new_thread) new_thread->start();
+    SDL_UnlockAudioDevice(dev);
+    delete old_thread;
+  }
+
+  size_t audionodes_get_xrun_count() {
+    return get_engine_health().get_snapshot().xruns;
+  }
+
+  void audionodes_get_engine_health(size_t *overruns, size_t *xruns, size_t *queue_high_water, size_t *dropped_messages, size_t *midi_overflows) {
+    EngineHealth::Snapshot snapshot = get_engine_health().get_snapshot();
+    *overruns = snapshot.overruns;
+    *xruns = snapshot.xruns;
+    *queue_high_water = snapshot.queue_high_water;
+    *dropped_messages = snapshot.dropped_messages;
+    *midi_overflows = snapshot.midi_overflows;
+  }
+
+  size_t audionodes_get_callback_histogram(size_t *buckets, size_t amount) {
+    EngineHealth::Snapshot snapshot = get_engine_health().get_snapshot();
+    amount = std::min(amount, EngineHealth::histogram_size);
+    std::copy_n(snapshot.callback_histogram, amount, buckets);
+    return EngineHealth::histogram_size;
+  }
+
+  void audionodes_reset_engine_health() {
+    get_engine_health().reset();
+  }
+
+  bool audionodes_set_sample_rate(int rate) {
+    if (initialized) {
+      std::cerr << "Audionodes native: Sample rate can only be changed before initialization" << std::endl;
+      return false;
+    }
+    if (rate < 0) {
+      std::cerr << "Audionodes native: Invalid sample rate " << rate << std::endl;
+      return false;
+    }
+    requested_rate = rate;
+    return true;
+  }
+
+  int audionodes_get_sample_rate() {
+    return RATE;
+  }
+
+  bool audionodes_set_block_size(size_t size) {
+    if (initialized) {
+      std::cerr << "Audionodes native: Block size can only be changed before initialization" << std::endl;
+      return false;
+    }
+    if (!is_supported_block_size(size)) {
+      std::cerr << "Audionodes native: Unsupported block size " << size << " (use 64, 128, 256 or 512, at most " << N << ")" << std::endl;
+      return false;
+    }
+    BLOCK_SIZE = size;
+    return true;
+  }
+
+  size_t audionodes_get_block_size() {
+    return BLOCK_SIZE;
+  }
+
+  bool audionodes_set_voice_lanes(size_t lanes) {
+    if (initialized) {
+      std::cerr << "Audionodes native: Voice lanes can only be changed before initialization" << std::endl;
+      return false;
+    }
+    if (!is_supported_voice_lanes(lanes)) {
+      std::cerr << "Audionodes native: Unsupported amount of voice lanes " << lanes << " (use 0, 4, 8 or 16)" << std::endl;
+      return false;
+    }
+    VOICE_LANES = lanes;
+    return true;
+  }
+
+  size_t audionodes_get_voice_lanes() {
+    return VOICE_LANES;
+  }
+
+  bool audionodes_get_node_timing(node_uid id, size_t *count, double *min, double *mean, double *max, double *p99, size_t *voices) {
+    Node *node = find_node(id);
+    if (!node) {
+      std::cerr << "Audionodes native: Tried to get timing of non-existent node " << id << std::endl;
+      return false;
+    }
+    TimingStats::Summary summary = node->timing.get_summary();
+    *count = summary.count;
+    *min = summary.min;
+    *mean = summary.mean;
+    *max = summary.max;
+    *p99 = summary.p99;
+    *voices = summary.voices;
+    return true;
+  }
+
+  void audionodes_reset_node_timing() {
+    node_storage.for_each([](node_uid, StoredNode &stored) {
+      stored.node->timing.reset();
+    });
+  }
+
+  void audionodes_set_worker_threads(size_t amount) {
+    WorkerPool *new_pool = amount > 0 ? new WorkerPool(amount) : nullptr;
+    if (new_pool) new_pool->set_min_parallel_voices(min_parallel_voices);
+    reclaimer.retire(worker_pool.exchange(new_pool));
+    reclaim_retired();
+  }
+
+  void audionodes_set_voice_parallelism(size_t min_voices) {
+    min_parallel_voices = min_voices;
+    WorkerPool *pool = worker_pool.load();
+    if (pool) pool->set_min_parallel_voices(min_voices);
+  }
+
+  void audionodes_set_pipeline_stages(size_t stages) {
+    pipeline_stages = std::max<size_t>(stages, 1);
+    // Takes effect with a new tree
+    publish_graph();
+  }
+
+  void audionodes_get_control_stats(size_t *coalesced, size_t *dropped) {
+    *coalesced = control_channel.get_coalesced_count();
+    *dropped = get_engine_health().get_snapshot().dropped_messages;
+  }
+
+  void audionodes_cleanup() {
+    // Closing waits for a running callback, no reader remains after this
+    if (dev != 0) SDL_CloseAudioDevice(dev);
+    delete render_thread;
+    render_thread = nullptr;
+    get_engine_health().reset();
+    reclaimer.reclaim_all();
+    delete worker_pool.exchange(nullptr);
+    dev = 0;
+    initialized = false;
+    offline = false;
+    leftover_amount = 0;
+    device_samples = 0;
+    node_storage.for_each([](node_uid, StoredNode &stored) {
+      delete stored.node;
+    });
     node_storage.clear();
-    delete main_node_tree;
-    main_node_tree = nullptr;
+    node_graph.clear();
+    delete main_node_tree.exchange(nullptr);
   }
 
   node_uid audionodes_create_node(const char* type) {
-    node_uid id = node_storage_alloc();
     if (get_node_types().count(type)) {
       Node *node = get_node_types().at(type)();
-      node_storage[id] = node;
+      // Constructors may set defaults, the pending values have to match
+      for (size_t i = 0; i < node->input_values.size(); ++i) {
+        node->pending_input_values[i].value = node->input_values[i];
+      }
+      for (size_t i = 0; i < node->property_values.size(); ++i) {
+        node->pending_property_values[i].value = node->property_values[i];
+      }
+      StoredNode stored;
+      stored.node = node;
+      stored.type = type;
+      node_uid id = node_storage.insert(stored);
+      if (id == -1) {
+        std::cerr << "Audionodes native: Too many nodes" << std::endl;
+        delete node;
+        return -1;
+      }
+      node_graph.add_node(id, node->get_input_count(), node->output_socket_types.size());
+      // A sink is evaluated even without links
+      graph_changed = true;
       return id;
     } else {
       std::cerr << "Audionodes native: Tried to create node of invalid type \"" << type << "\"" << std::endl;
@@ -168,16 +605,28 @@ extern "C" {
   node_uid audionodes_copy_node(node_uid old_id, const char* type_c) {
     node_uid new_id = audionodes_create_node(type_c);
     if (new_id == -1) return -1;
-    node_storage[new_id]->copy_input_values(*node_storage[old_id]);
+    StoredNode *old_stored = node_storage.find(old_id);
+    if (old_stored) {
+      StoredNode &stored = node_storage[new_id];
+      stored.node->copy_input_values(*old_stored->node);
+      if (old_stored->type == stored.type) {
+        for (auto &slot_payload_pair : old_stored->binaries) {
+          send_binary(stored, slot_payload_pair.first, slot_payload_pair.second);
+        }
+      }
+    }
     return new_id;
   }
 
   void audionodes_remove_node(node_uid id) {
-    if (!node_storage.count(id)) {
+    Node *node = find_node(id);
+    if (!node) {
       std::cerr << "Audionodes native: Tried to remove non-existent node " << id << std::endl;
       return;
     }
-    node_storage[id]->mark_deletion = true;
+    node->mark_deletion = true;
+    // Removed with the next published tree
+    graph_changed = true;
   }
   
   bool audionodes_node_exists(node_uid id) {
@@ -185,30 +634,31 @@ extern "C" {
   }
 
   void audionodes_update_node_input_value(node_uid id, int input_index, float value) {
-    if (!node_storage.count(id)) {
+    Node *node = find_node(id);
+    if (!node) {
       std::cerr << "Audionodes native: Tried to update input value of non-existent node " << id << std::endl;
       return;
     }
-    send_message(Message(node_storage[id], input_index, value));
+    send_message(Message(node, input_index, value));
   }
 
   void audionodes_update_node_property_value(node_uid id, int enum_index, int value) {
-    if (!node_storage.count(id)) {
+    Node *node = find_node(id);
+    if (!node) {
       std::cerr << "Audionodes native: Tried to update property value of non-existent node " << id << std::endl;
       return;
     }
-    send_message(Message(node_storage[id], enum_index, value));
+    send_message(Message(node, enum_index, value));
   }
   
   void audionodes_send_node_binary_data(node_uid id, int slot, int length, void *_bin) {
-    if (!node_storage.count(id)) {
+    StoredNode *stored = node_storage.find(id);
+    if (!stored) {
       std::cerr << "Audionodes native: Tried to send binary data to non-existent node " << id << std::endl;
       return;
     }
-    // Node (or send_message on failure) will handle deletion
-    char *bin = new char[length];
-    std::memcpy(bin, _bin, length);
-    send_message(Message(node_storage[id], slot, length, bin));
+    const char *bin = static_cast<const char*>(_bin);
+    send_binary(*stored, slot, std::make_shared<const std::vector<char>>(bin, bin+length));
   }
 
   std::vector<NodeTree::ConstructionLink>* audionodes_begin_tree_update() {
@@ -224,112 +674,263 @@ extern "C" {
     links->push_back({from_node, to_node, from_socket, to_socket});
   }
 
-  void audionodes_finish_tree_update(std::vector<NodeTree::ConstructionLink> *links) {
-    std::map<node_uid, std::vector<NodeTree::ConstructionLink>> links_to;
-    std::map<node_uid, int> links_from_count;
-    for (auto link : *links) {
-      links_to[link.to_node].push_back(link);
-    }
-    // Breadth first search from sinks to find reverse topological order
-    std::vector<node_uid> q;
-    std::vector<node_uid> marked_for_deletion;
-    // will contain all nodes that need to be evaluated (directly or indirectly connected to a sink)
-    std::set<node_uid> to_process;
-    std::vector<node_uid> to_process_q;
-    for (auto &id_node_pair : node_storage) {
-      if (id_node_pair.second->mark_deletion) {
-        marked_for_deletion.push_back(id_node_pair.first);
-      } else {
-        if (id_node_pair.second->get_is_sink()) {
-          q.push_back(id_node_pair.first);
-          to_process.insert(id_node_pair.first);
-          to_process_q.push_back(id_node_pair.first);
-        }
+  bool audionodes_finish_tree_update(std::vector<NodeTree::ConstructionLink> *links) {
+    // Only apply the difference to the persistent graph
+    std::unordered_set<NodeGraph::Link, NodeGraph::LinkHash> wanted(links->begin(), links->end());
+    std::set<std::pair<node_uid, size_t>> linked_inputs;
+    for (auto link : wanted) {
+      Node *from = find_node(link.from_node), *to = find_node(link.to_node);
+      if (!from || !to || from->mark_deletion || to->mark_deletion) continue;
+      const char *error = nullptr;
+      if (!node_graph.has_sockets(link)) {
+        error = "link between non-existent sockets";
+      } else if (!linked_inputs.emplace(link.to_node, link.to_socket).second) {
+        error = "input linked twice";
       }
-    }
-    for (size_t i = 0; i < to_process_q.size(); ++i) {
-      node_uid id = to_process_q[i];
-      for (auto link : links_to[id]) {
-        if (node_storage[link.from_node]->mark_deletion) continue;
-        links_from_count[link.from_node]++;
-        if (to_process.count(link.from_node)) continue;
-        to_process.insert(link.from_node);
-        to_process_q.push_back(link.from_node);
+      if (error) {
+        std::cerr << "Audionodes Native: Error building tree: " << error << " " << link.from_node << " " << link.to_node << std::endl;
+        delete links;
+        return false;
       }
     }
-    for (size_t i = 0; i < q.size(); ++i) {
-      node_uid id = q[i];
-      for (auto link : links_to[id]) {
-        if (!to_process.count(link.from_node)) continue;
-        links_from_count[link.from_node]--;
-        if (links_from_count[link.from_node] == 0) {
-          q.push_back(link.from_node);
-        }
+    std::vector<NodeTree::ConstructionLink> removed, added;
+    for (auto link : node_graph.get_links()) {
+      if (!wanted.count(link)) removed.push_back(link);
+    }
+    for (auto link : removed) node_graph.remove_link(link);
+    bool success = true;
+    for (auto link : *links) {
+      Node *from = find_node(link.from_node), *to = find_node(link.to_node);
+      if (!from || !to || from->mark_deletion || to->mark_deletion) continue;
+      if (node_graph.has_link(link)) continue;
+      if (!node_graph.add_link(link)) {
+        success = false;
+        break;
       }
+      added.push_back(link);
     }
-    if (q.size() < to_process.size()) {
-      // Not all nodes that were supposed to be included got into the order ->
-      // there is a loop
+    delete links;
+    if (!success) {
       std::cerr << "Audionodes Native: Error building tree: loop found" << std::endl;
-      delete links;
+      for (auto link : added) node_graph.remove_link(link);
+      for (auto link : removed) node_graph.add_link(link);
+      return false;
+    }
+    // Blender sends the full list on any change, most of the time nothing
+    // the tree depends on
+    if (!removed.empty() || !added.empty() || graph_changed) graph_edited();
+    return true;
+  }
+
+  void audionodes_begin_graph_edit() {
+    graph_edit_depth++;
+  }
+
+  void audionodes_end_graph_edit() {
+    if (graph_edit_depth == 0) {
+      std::cerr << "Audionodes native: Graph edit ended without beginning" << std::endl;
       return;
     }
-    
-    // Reverse the resulting vector to have the correct evaluation order
-    std::reverse(q.begin(), q.end());
+    graph_edit_depth--;
+    if (graph_edit_depth == 0 && graph_changed) publish_graph();
+  }
 
-    // Collect final evaluation order and links
-    std::vector<Node*> final_order(q.size());
-    std::vector<std::vector<NodeTree::Link>> final_links(q.size());
+  bool audionodes_save_graph(const char *path) {
+    GraphFile graph;
     std::map<node_uid, size_t> node_index;
-    for (size_t i = 0; i < q.size(); ++i) {
-      node_uid id = q[i];
-      node_index[id] = i;
-      Node *node = node_storage[id];
-      final_order[i] = node;
-      final_links[i] = std::vector<NodeTree::Link>(node->get_input_count());
-      for (auto link : links_to[id]) {
-        if (!to_process.count(link.from_node)) continue;
-        final_links[i][link.to_socket] = NodeTree::Link(true, node_index[link.from_node], link.from_socket);
+    node_storage.for_each([&](node_uid id, StoredNode &stored) {
+      Node *node = stored.node;
+      if (node->mark_deletion) return;
+      GraphFile::Node description;
+      description.name = "n" + std::to_string(id);
+      description.type = stored.type;
+      // The pending values always hold the latest value sent
+      for (size_t i = 0; i < node->get_input_count(); ++i) {
+        description.inputs.emplace_back(i, node->pending_input_values[i].value.load());
       }
+      for (size_t i = 0; i < node->property_types.size(); ++i) {
+        description.properties.emplace_back(i, node->pending_property_values[i].value.load());
+      }
+      for (auto &slot_payload_pair : stored.binaries) {
+        description.binaries.emplace_back(slot_payload_pair.first, *slot_payload_pair.second);
+      }
+      node_index[id] = graph.nodes.size();
+      graph.nodes.push_back(description);
+    });
+    for (auto link : node_graph.get_links()) {
+      if (!node_index.count(link.from_node) || !node_index.count(link.to_node)) continue;
+      graph.links.push_back({node_index[link.from_node], link.from_socket, node_index[link.to_node], link.to_socket});
+    }
+    std::ofstream file(path);
+    graph.write(file);
+    if (!file) {
+      std::cerr << "Audionodes native: Unable to write graph to \"" << path << "\"" << std::endl;
+      return false;
     }
+    return true;
+  }
 
-    // Call callbacks on newly connected nodes
-    for (Node *node : final_order) {
-      if (!node->mark_connected) {
-        node->mark_connected = true;
-        node->connect_callback();
+  bool audionodes_load_graph(const char *path) {
+    std::ifstream file(path);
+    GraphFile graph;
+    std::string error;
+    if (!file) {
+      error = "unable to open file";
+    } else {
+      graph.read(file, error);
+    }
+    std::vector<node_uid> ids;
+    for (auto &description : graph.nodes) {
+      if (!error.empty()) break;
+      node_uid id = audionodes_create_node(description.type.c_str());
+      if (id == -1) {
+        error = "invalid node type " + description.type;
+        break;
+      }
+      ids.push_back(id);
+      Node *node = node_storage[id].node;
+      for (auto &input : description.inputs) {
+        if (input.first >= node->get_input_count()) {
+          error = "input index out of range in node " + description.name;
+          break;
+        }
+        audionodes_update_node_input_value(id, input.first, input.second);
+      }
+      if (!error.empty()) break;
+      for (auto &property : description.properties) {
+        if (property.first >= node->property_types.size()) {
+          error = "property index out of range in node " + description.name;
+          break;
+        }
+        audionodes_update_node_property_value(id, property.first, property.second);
+      }
+      if (!error.empty()) break;
+      for (auto &binary : description.binaries) {
+        audionodes_send_node_binary_data(id, binary.first, binary.second.size(), binary.second.data());
       }
-      node->_tmp_connected = true;
     }
-
-    // Make a new node tree with the newly acquired evaluation parameters
-    NodeTree *new_node_tree = new NodeTree(final_order, final_links);
-    NodeTree *old_node_tree = main_node_tree;
-    // Substitute the active node tree safely
-    SDL_LockAudioDevice(dev);
-    main_node_tree = new_node_tree;
-    SDL_UnlockAudioDevice(dev);
-    delete old_node_tree;
-
-    // Call callbacks on newly disconnected nodes
-    for (auto &id_node_pair : node_storage) {
-      Node *node = id_node_pair.second;
-      if (!node->_tmp_connected && node->mark_connected) {
-        node->mark_connected = false;
-        node->disconnect_callback();
+    // Inputs take at most one link
+    std::set<std::pair<size_t, size_t>> linked_inputs;
+    for (auto &link : graph.links) {
+      if (!error.empty()) break;
+      Node *from = node_storage[ids[link.from_node]].node, *to = node_storage[ids[link.to_node]].node;
+      if (link.from_socket >= from->output_socket_types.size()) {
+        error = "output index out of range in link from node " + graph.nodes[link.from_node].name;
+      } else if (link.to_socket >= to->get_input_count()) {
+        error = "input index out of range in link to node " + graph.nodes[link.to_node].name;
+      } else if (!linked_inputs.emplace(link.to_node, link.to_socket).second) {
+        error = "input linked twice in node " + graph.nodes[link.to_node].name;
       }
-      node->_tmp_connected = false;
     }
+    if (!error.empty()) {
+      std::cerr << "Audionodes native: Unable to load graph \"" << path << "\": " << error << std::endl;
+      for (node_uid id : ids) audionodes_remove_node(id);
+      return false;
+    }
+    // Keep the existing links, the loaded graph is added next to them
+    auto *links = new std::vector<NodeTree::ConstructionLink>(node_graph.get_links());
+    for (auto &link : graph.links) {
+      links->push_back({ids[link.from_node], ids[link.to_node], link.from_socket, link.to_socket});
+    }
+    if (!audionodes_finish_tree_update(links)) {
+      std::cerr << "Audionodes native: Unable to load graph \"" << path << "\": loop found" << std::endl;
+      for (node_uid id : ids) audionodes_remove_node(id);
+      return false;
+    }
+    return true;
+  }
 
-    // Lastly, we clean up the removed nodes
-    for (node_uid id : marked_for_deletion) {
-      Node *node = node_storage[id];
-      delete node;
-      node_storage.erase(id);
+  bool audionodes_add_link(node_uid from_node, node_uid to_node, size_t from_socket, size_t to_socket) {
+    if (!node_storage.count(from_node) || !node_storage.count(to_node)) {
+      std::cerr << "Audionodes native: Tried to create a link to/from non-existent node " << from_node << " " << to_node << std::endl;
+      return false;
+    }
+    NodeGraph::Link link = {from_node, to_node, from_socket, to_socket};
+    if (!node_graph.has_sockets(link)) {
+      std::cerr << "Audionodes native: Tried to create a link between non-existent sockets " << from_socket << " " << to_socket << std::endl;
+      return false;
+    }
+    if (node_graph.has_link(link)) return true;
+    // A link into an already linked input replaces the old one, like in the editor
+    const NodeGraph::Link *occupant = node_graph.find_link_to(to_node, to_socket);
+    NodeGraph::Link replaced;
+    if (occupant) {
+      replaced = *occupant;
+      node_graph.remove_link(replaced);
     }
+    if (!node_graph.add_link(link)) {
+      std::cerr << "Audionodes Native: Error adding link: loop found" << std::endl;
+      if (occupant) node_graph.add_link(replaced);
+      return false;
+    }
+    graph_edited();
+    return true;
+  }
 
-    delete links;
+  bool audionodes_remove_link(node_uid from_node, node_uid to_node, size_t from_socket, size_t to_socket) {
+    if (!node_graph.remove_link({from_node, to_node, from_socket, to_socket})) {
+      std::cerr << "Audionodes native: Tried to remove non-existent link " << from_node << " " << to_node << std::endl;
+      return false;
+    }
+    graph_edited();
+    return true;
+  }
+
+  bool audionodes_replace_node(node_uid old_id, node_uid new_id) {
+    if (!node_storage.count(old_id) || !node_storage.count(new_id)) {
+      std::cerr << "Audionodes native: Tried to replace non-existent node " << old_id << " " << new_id << std::endl;
+      return false;
+    }
+    // Move all links over to the new node, which needs to have their sockets
+    std::vector<NodeTree::ConstructionLink> links_to = node_graph.get_links_to(old_id);
+    std::vector<NodeTree::ConstructionLink> links_from = node_graph.get_links_from(old_id);
+    Node *new_node = node_storage[new_id].node;
+    for (auto link : links_to) {
+      if (link.to_socket >= new_node->get_input_count() || node_graph.find_link_to(new_id, link.to_socket)) {
+        std::cerr << "Audionodes native: Replacing node lacks a free input " << link.to_socket << std::endl;
+        return false;
+      }
+    }
+    for (auto link : links_from) {
+      if (link.from_socket >= new_node->output_socket_types.size()) {
+        std::cerr << "Audionodes native: Replacing node lacks output " << link.from_socket << std::endl;
+        return false;
+      }
+    }
+    node_graph.remove_node(old_id);
+    std::vector<NodeTree::ConstructionLink> added;
+    bool success = true;
+    for (auto link : links_to) {
+      link.to_node = new_id;
+      if (node_graph.has_link(link)) continue;
+      if (!node_graph.add_link(link)) {
+        success = false;
+        break;
+      }
+      added.push_back(link);
+    }
+    for (auto link : links_from) {
+      if (!success) break;
+      link.from_node = new_id;
+      if (node_graph.has_link(link)) continue;
+      if (!node_graph.add_link(link)) {
+        success = false;
+        break;
+      }
+      added.push_back(link);
+    }
+    if (!success) {
+      std::cerr << "Audionodes Native: Error replacing node: loop found" << std::endl;
+      for (auto link : added) node_graph.remove_link(link);
+      Node *old_node = node_storage[old_id].node;
+      node_graph.add_node(old_id, old_node->get_input_count(), old_node->output_socket_types.size());
+      for (auto link : links_to) node_graph.add_link(link);
+      for (auto link : links_from) node_graph.add_link(link);
+      return false;
+    }
+    node_storage[old_id].node->mark_deletion = true;
+    graph_edited();
+    return true;
   }
 }
 
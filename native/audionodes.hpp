@@ -4,15 +4,30 @@
 
 #include "common.hpp"
 #include "node_tree.hpp"
+#include "node_graph.hpp"
 #include "util/circular_buffer.hpp"
+#include "util/wav_writer.hpp"
+#include "util/graph_file.hpp"
+#include "util/slot_map.hpp"
 #include "node.hpp"
+#include "worker_pool.hpp"
+#include "control_channel.hpp"
+#include "reclamation.hpp"
+#include "render_thread.hpp"
+#include "engine_health.hpp"
 
 #include <iostream>
 #include <map>
+#include <memory>
 #include <set>
+#include <unordered_set>
+#include <unordered_map>
 #include <mutex>
 #include <thread>
+#include <atomic>
+#include <chrono>
 #include <cstring>
+#include <fstream>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_audio.h>
 
@@ -39,6 +54,7 @@ struct Message {
 };
 
 typedef std::map<std::string, Node::Creator> NodeTypeMap;
+NodeTypeMap& get_node_types();
 
 }
 
@@ -0,0 +1,989 @@
+#include "audionodes.hpp"
+#include "node_tree.hpp"
+#include "polyphony.hpp"
+#include "util/circular_buffer.hpp"
+#include "util/kernels.hpp"
+#include "util/fast_math.hpp"
+#include "data/midi.hpp"
+extern "C" {
+#include "c_interface.h"
+}
+
+#include <chrono>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <limits>
+#include <map>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <cstdio>
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Throughput measurements of the native library, printed as one JSON
+// object per line so that the results of two builds can be compared.
+// Usage: bench [filter] [seconds per measurement] [block size]
+// Only measurements whose name contains filter are run. The checks
+// (check_*) compare optimized code with reference results, the exit
+// status is 1 if any of them fails.
+
+using namespace audionodes;
+
+namespace {
+
+std::string filter;
+double min_seconds = 0.2;
+
+bool enabled(const std::string &name) {
+  return name.find(filter) != std::string::npos;
+}
+
+// Call function repeatedly until min_seconds have passed,
+// returns the average time per call in nanoseconds
+template<class F>
+double measure(F function) {
+  typedef std::chrono::steady_clock Clock;
+  // Warm up caches and lazily allocated buffers
+  for (size_t i = 0; i < 4; ++i) function();
+  size_t iterations = 0, batch = 1;
+  double elapsed = 0;
+  auto start = Clock::now();
+  while (elapsed < min_seconds) {
+    for (size_t i = 0; i < batch; ++i) function();
+    iterations += batch;
+    elapsed = std::chrono::duration<double>(Clock::now()-start).count();
+    if (batch < 1024) batch *= 2;
+  }
+  return elapsed*1e9/iterations;
+}
+
+// Make the compiler assume that value is read and all memory changed, so
+// that results of the measured code can't be optimized away
+template<class T>
+inline void do_not_optimize(T &value) {
+#ifndef _MSC_VER
+  asm volatile("" : : "r"(&value) : "memory");
+#else
+  static const void *volatile sink;
+  sink = &value;
+  _ReadWriteBarrier();
+#endif
+}
+
+// fields: further JSON members, e.g. "\"voices\":8"
+void report(const std::string &name, const std::string &fields, double ns_per_op, double samples_per_op = 0) {
+  std::ostringstream line;
+  line << "{\"bench\":\"" << name << "\"";
+  if (!fields.empty()) line << "," << fields;
+  line << ",\"block_size\":" << BLOCK_SIZE << ",\"ns_per_op\":" << ns_per_op;
+  if (samples_per_op > 0) {
+    // Relative to realtime at the default rate
+    line << ",\"realtime_factor\":" << samples_per_op/DEFAULT_RATE/(ns_per_op*1e-9);
+  }
+  line << "}";
+  std::cout << line.str() << std::endl;
+}
+
+// Chunk kernels, one block per call
+void bench_kernels() {
+  Chunk a, b, c;
+  kernels::ramp(a, -2, 2);
+  kernels::fill(b, 1);
+  kernels::fill(c, 0);
+  int16_t converted[N];
+  auto run = [](const std::string &kernel, double ns) {
+    report("kernels", "\"kernel\":\"" + kernel + "\"", ns, BLOCK_SIZE);
+  };
+  run("fill", measure([&]() { kernels::fill(c, a[0]); do_not_optimize(c); }));
+  run("ramp", measure([&]() { kernels::ramp(c, a[0], a[1]); do_not_optimize(c); }));
+  run("add", measure([&]() { kernels::add(c, a); do_not_optimize(c); }));
+  run("mul", measure([&]() { kernels::mul(c, b); do_not_optimize(c); }));
+  run("min", measure([&]() { kernels::min(c, a); do_not_optimize(c); }));
+  run("max", measure([&]() { kernels::max(c, a); do_not_optimize(c); }));
+  run("mul_add", measure([&]() { kernels::mul_add(c, b, a); do_not_optimize(c); }));
+  run("select", measure([&]() { kernels::select(c, a, b, c); do_not_optimize(c); }));
+  run("clamp_to_int16", measure([&]() { kernels::clamp_to_int16(a.data(), converted, BLOCK_SIZE); do_not_optimize(converted); }));
+}
+
+// Result of a check, printed like the measurements
+bool report_check(const std::string &name, const std::string &fields, bool passed) {
+  std::cout << "{\"check\":\"" << name << "\"," << fields
+            << ",\"passed\":" << (passed ? "true" : "false") << "}" << std::endl;
+  return passed;
+}
+
+// Equal bits, or both NaN
+bool same_sample(SigT a, SigT b) {
+  return (std::isnan(a) && std::isnan(b)) || std::memcmp(&a, &b, sizeof(SigT)) == 0;
+}
+
+// The chunk kernels against the scalar expressions they replace, at every
+// block size, with prefix lengths covering each tail and unaligned
+// buffers for clamp_to_int16. Results have to match bit for bit and
+// nothing past the processed samples may be written.
+bool check_kernels() {
+  std::mt19937 random(1);
+  // Ordinary samples with the values where vector and scalar code tend to
+  // part ways mixed in
+  const SigT infinity = std::numeric_limits<SigT>::infinity();
+  const std::vector<SigT> specials = {0.f, -0.f, 1.f, -1.f, 0.99999994f, -1.0000001f,
+    1e-40f, -1e-40f, 3e38f, infinity, -infinity, std::numeric_limits<SigT>::quiet_NaN()};
+  std::uniform_real_distribution<SigT> ordinary(-2, 2);
+  std::uniform_int_distribution<size_t> pick(0, 4*specials.size()-1);
+  auto sample = [&]() {
+    size_t i = pick(random);
+    return i < specials.size() ? specials[i] : ordinary(random);
+  };
+  auto randomize = [&](Chunk &chunk) {
+    for (SigT &value : chunk) value = sample();
+  };
+  const size_t rounds = 200;
+  const size_t engine_block_size = BLOCK_SIZE;
+  bool passed = true;
+  for (size_t block_size : {64, 128, 256, 512}) {
+    if (!is_supported_block_size(block_size)) continue;
+    BLOCK_SIZE = block_size;
+    std::map<std::string, size_t> mismatches;
+    auto compare = [&](const std::string &kernel, const Chunk &result, const Chunk &expected) {
+      size_t &count = mismatches[kernel];
+      for (size_t j = 0; j < N; ++j) {
+        if (!same_sample(result[j], expected[j])) {
+          count++;
+          break;
+        }
+      }
+    };
+    std::uniform_int_distribution<size_t> length_distribution(0, block_size);
+    for (size_t round = 0; round < rounds; ++round) {
+      Chunk out, in, factor, addend, condition, a, b, expected, result;
+      for (Chunk *chunk : {&out, &in, &factor, &addend, &condition, &a, &b}) randomize(*chunk);
+      
+      expected = out;
+      for (size_t j = 0; j < block_size; ++j) expected[j] = out[j]*factor[j] + addend[j];
+      result = out;
+      kernels::mul_add(result, factor, addend);
+      compare("mul_add", result, expected);
+      
+      expected = out;
+      for (size_t j = 0; j < block_size; ++j) expected[j] = condition[j] != 0 ? a[j] : b[j];
+      result = out;
+      kernels::select(result, condition, a, b);
+      compare("select", result, expected);
+      
+      SigT value = sample();
+      expected = out;
+      for (size_t j = 0; j < block_size; ++j) expected[j] = value;
+      result = out;
+      kernels::fill(result, value);
+      compare("fill", result, expected);
+      
+      SigT from = ordinary(random), to = ordinary(random);
+      size_t offset = round%4;
+      expected = out;
+      for (size_t j = 0; j < block_size; ++j) {
+        expected[j] = ((SigT(block_size)-SigT(j+offset))*from + SigT(j+offset)*to)/block_size;
+      }
+      result = out;
+      kernels::ramp(result, from, to, offset);
+      compare("ramp", result, expected);
+      
+      // Whole blocks and prefixes
+      size_t length = round%2 ? length_distribution(random) : block_size;
+      auto binary = [&](const std::string &kernel, void (*function)(Chunk&, const Chunk&, size_t), SigT (*scalar)(SigT, SigT)) {
+        Chunk expected = out, result = out;
+        for (size_t j = 0; j < length; ++j) expected[j] = scalar(out[j], in[j]);
+        function(result, in, length);
+        compare(kernel, result, expected);
+        if (length == block_size) {
+          result = out;
+          void (*whole)(Chunk&, const Chunk&) = kernels::add;
+          if (kernel == "mul") whole = kernels::mul;
+          if (kernel == "min") whole = kernels::min;
+          if (kernel == "max") whole = kernels::max;
+          whole(result, in);
+          compare(kernel, result, expected);
+        }
+      };
+      binary("add", kernels::add, [](SigT y, SigT x) { return y + x; });
+      binary("mul", kernels::mul, [](SigT y, SigT x) { return y * x; });
+      binary("min", kernels::min, [](SigT y, SigT x) { return std::min(y, x); });
+      binary("max", kernels::max, [](SigT y, SigT x) { return std::max(y, x); });
+    }
+    for (auto &kernel_count : mismatches) {
+      std::ostringstream fields;
+      fields << "\"kernel\":\"" << kernel_count.first << "\",\"block_size\":" << block_size
+             << ",\"cases\":" << rounds << ",\"mismatches\":" << kernel_count.second;
+      passed &= report_check("kernels", fields.str(), kernel_count.second == 0);
+    }
+  }
+  BLOCK_SIZE = engine_block_size;
+  
+  // clamp_to_int16 works on plain buffers, every offset modulo the vector
+  // width and lengths covering every tail of its 8 sample steps. NaN has
+  // no defined scalar result.
+  const int16_t maximum_value = (1 << 15)-1, minimum_value = -(1 << 15), guard = 0x5a5a;
+  std::vector<SigT> input(N+8);
+  std::vector<int16_t> result(N+16), expected(N+16);
+  size_t cases = 0, mismatches = 0;
+  for (size_t in_offset = 0; in_offset < 4; ++in_offset) {
+    for (size_t out_offset = 0; out_offset < 8; ++out_offset) {
+      for (size_t length = 0; length <= 32; ++length) {
+        for (SigT &value : input) {
+          do value = sample(); while (std::isnan(value));
+        }
+        std::fill(result.begin(), result.end(), guard);
+        std::fill(expected.begin(), expected.end(), guard);
+        for (size_t j = 0; j < length; ++j) {
+          SigT value = input[in_offset+j];
+          if (value < -1) {
+            expected[out_offset+j] = minimum_value;
+          } else if (value >= 1) {
+            expected[out_offset+j] = maximum_value;
+          } else {
+            expected[out_offset+j] = value * maximum_value;
+          }
+        }
+        kernels::clamp_to_int16(input.data()+in_offset, result.data()+out_offset, length);
+        cases++;
+        if (result != expected) mismatches++;
+      }
+    }
+  }
+  std::ostringstream fields;
+  fields << "\"kernel\":\"clamp_to_int16\",\"cases\":" << cases << ",\"mismatches\":" << mismatches;
+  passed &= report_check("kernels", fields.str(), mismatches == 0);
+  return passed;
+}
+
+// Unit in the last place of a float near x, subnormal ones included
+double float_ulp(double x) {
+  int exponent = std::max(std::ilogb(SigT(x)), std::numeric_limits<SigT>::min_exponent-1);
+  return std::ldexp(1., exponent-std::numeric_limits<SigT>::digits+1);
+}
+
+// Distance of a float result from the exact (double) one in ulp of the
+// exact result, infinite unless NaN and infinities match exactly. Exact
+// results beyond the float range count as infinities.
+double ulp_error(SigT result, double exact) {
+  if (std::isnan(exact)) return std::isnan(result) ? 0 : INFINITY;
+  if (std::fabs(exact) > std::numeric_limits<SigT>::max()) exact *= INFINITY;
+  if (std::isinf(exact)) return result == exact ? 0 : INFINITY;
+  if (!std::isfinite(result)) return INFINITY;
+  return std::fabs(result-exact)/float_ulp(exact);
+}
+
+// The fast_math functions against double precision libm over random
+// arguments in each documented range, and over pairs of special values.
+// Fails where an error exceeds the bound documented in fast_math.hpp.
+bool check_fast_math() {
+  using namespace fast_math;
+  typedef std::function<Lanes(Lanes, Lanes)> Approximation;
+  typedef std::function<double(double, double)> Exact;
+  // Allowed error in ulp given the arguments and the exact result
+  typedef std::function<double(double, double, double)> Bound;
+  auto ulps = [](double amount) -> Bound {
+    return [amount](double, double, double) { return amount; };
+  };
+  auto absolute = [](double amount) -> Bound {
+    return [amount](double, double, double exact) { return amount/float_ulp(exact); };
+  };
+  const double sin_cos_bound = std::ldexp(1., -23);
+  // Outside (-pi/2, pi/2) the reduced argument is off by up to 2^-25
+  Bound tan_bound = [](double, double, double exact) {
+    return 3 + std::ldexp(1., -25)*(1+exact*exact)/float_ulp(exact);
+  };
+  Bound pow_bound = [](double, double, double exact) {
+    return 2 + 2*std::fabs(std::log(std::fabs(exact)));
+  };
+  struct Case {
+    std::string function;
+    Approximation approximation;
+    Exact exact;
+    Bound bound;
+    // Defined for all arguments, not only in a documented domain
+    bool total;
+  };
+  std::vector<Case> cases = {
+    {"sin", [](Lanes x, Lanes) { return sin(x); }, [](double x, double) { return std::sin(x); }, absolute(sin_cos_bound), true},
+    {"cos", [](Lanes x, Lanes) { return cos(x); }, [](double x, double) { return std::cos(x); }, absolute(sin_cos_bound), true},
+    {"tan", [](Lanes x, Lanes) { return tan(x); }, [](double x, double) { return std::tan(x); }, tan_bound, true},
+    {"asin", [](Lanes x, Lanes) { return asin(x); }, [](double x, double) { return std::asin(x); }, ulps(3), true},
+    {"acos", [](Lanes x, Lanes) { return acos(x); }, [](double x, double) { return std::acos(x); }, ulps(2), true},
+    {"atan", [](Lanes x, Lanes) { return atan(x); }, [](double x, double) { return std::atan(x); }, ulps(3), true},
+    {"log_normal", [](Lanes x, Lanes) { return log_normal(x); }, [](double x, double) { return std::log(x); }, ulps(1), false},
+    {"log_ratio", [](Lanes x, Lanes y) { return log_ratio(x, y); }, [](double x, double y) { return std::log(x)/std::log(y); }, ulps(3), true},
+    {"exp_normal", [](Lanes x, Lanes) { return exp_normal(x); }, [](double x, double) { return std::exp(x); }, ulps(1.1), false},
+    {"pow", [](Lanes x, Lanes y) { return pow(x, y); }, [](double x, double y) { return std::pow(x, y); }, pow_bound, true},
+    {"round", [](Lanes x, Lanes) { return round(x); }, [](double x, double) { return std::round(x); }, ulps(0), true},
+    {"fmod", [](Lanes x, Lanes y) { return fmod(x, y); }, [](double x, double y) { return std::fmod(x, y); }, ulps(0), true},
+  };
+  auto find_case = [&](const std::string &function) -> const Case& {
+    for (const Case &entry : cases) {
+      if (entry.function == function) return entry;
+    }
+    return cases.front();
+  };
+  
+  // Arguments drawn uniformly, or uniformly in their logarithm
+  struct Range {
+    std::string function;
+    SigT x_low, x_high, y_low, y_high;
+    bool logarithmic;
+  };
+  const std::vector<Range> ranges = {
+    {"sin", -10, 10, 0, 0, false},
+    {"sin", -trig_range, trig_range, 0, 0, false},
+    {"sin", trig_range, 1e6, 0, 0, false},
+    {"cos", -10, 10, 0, 0, false},
+    {"cos", -trig_range, trig_range, 0, 0, false},
+    {"tan", -1.57f, 1.57f, 0, 0, false},
+    {"tan", -trig_range, trig_range, 0, 0, false},
+    {"asin", -1, 1, 0, 0, false},
+    {"acos", -1, 1, 0, 0, false},
+    {"atan", -3, 3, 0, 0, false},
+    {"atan", 1e-30f, 1e30f, 0, 0, true},
+    {"log_normal", 0.5f, 2, 0, 0, false},
+    {"log_normal", std::numeric_limits<SigT>::min(), std::numeric_limits<SigT>::max(), 0, 0, true},
+    {"log_ratio", 1e-3f, 1e3f, 1.5f, 100, true},
+    {"log_ratio", 1e-44f, 1e-38f, 0.1f, 0.9f, true},
+    {"exp_normal", -87, 87, 0, 0, false},
+    {"pow", 0, 4, -4, 4, false},
+    {"pow", 1e-3f, 1e3f, -10, 10, true},
+    {"pow", 1e-6f, 1e6f, -6, 6, true},
+    {"pow", -4, 0, -4, 4, false},
+    {"round", -3, 3, 0, 0, false},
+    {"round", -1e9f, 1e9f, 0, 0, false},
+    {"fmod", -100, 100, -3, 3, false},
+    {"fmod", -1e7f, 1e7f, 0.5f, 3, false},
+    {"fmod", -1, 1, -1e-3f, 1e-3f, false},
+  };
+  const size_t samples = 1 << 18;
+  std::mt19937 random(1);
+  std::uniform_real_distribution<double> unit(0, 1);
+  bool passed = true;
+  for (const Range &range : ranges) {
+    const Case &entry = find_case(range.function);
+    double max_error = 0;
+    size_t violations = 0;
+    for (size_t i = 0; i < samples; i += Lanes::width) {
+      SigT x[Lanes::width], y[Lanes::width], result[Lanes::width];
+      for (size_t l = 0; l < Lanes::width; ++l) {
+        double position = unit(random);
+        if (range.logarithmic) {
+          x[l] = std::exp(std::log(range.x_low) + (std::log(range.x_high)-std::log(range.x_low))*position);
+        } else {
+          x[l] = range.x_low + (double(range.x_high)-range.x_low)*position;
+        }
+        y[l] = range.y_low + (double(range.y_high)-range.y_low)*unit(random);
+      }
+      // Negative bases only have real powers with integer exponents
+      if (range.function == "pow" && range.x_high <= 0) {
+        for (SigT &exponent : y) exponent = std::round(exponent);
+      }
+      entry.approximation(Lanes::load(x), Lanes::load(y)).store(result);
+      for (size_t l = 0; l < Lanes::width; ++l) {
+        double exact = entry.exact(x[l], y[l]);
+        double error = ulp_error(result[l], exact);
+        max_error = std::max(max_error, error);
+        if (error != 0 && !(error <= entry.bound(x[l], y[l], exact))) violations++;
+      }
+    }
+    std::ostringstream fields;
+    fields << "\"function\":\"" << range.function << "\",\"range\":\"[" << range.x_low << ", " << range.x_high << "]";
+    if (range.y_low != range.y_high) fields << "x[" << range.y_low << ", " << range.y_high << "]";
+    fields << "\",\"samples\":" << samples << ",\"max_ulp\":" << max_error << ",\"violations\":" << violations;
+    passed &= report_check("fast_math", fields.str(), violations == 0);
+  }
+  
+  // Every pair of special values, in all lanes at once
+  const SigT infinity = std::numeric_limits<SigT>::infinity();
+  const std::vector<SigT> specials = {0.f, -0.f, 1.f, -1.f, 2.f, -2.f, 0.5f, -3.f, 1e-40f, -1e-40f,
+    infinity, -infinity, std::numeric_limits<SigT>::quiet_NaN()};
+  for (const Case &entry : cases) {
+    if (!entry.total) continue;
+    size_t violations = 0;
+    for (SigT x : specials) {
+      for (SigT y : specials) {
+        SigT result[Lanes::width];
+        entry.approximation(Lanes(x), Lanes(y)).store(result);
+        double exact = entry.exact(x, y);
+        double error = ulp_error(result[0], exact);
+        if (error != 0 && !(error <= entry.bound(x, y, exact))) violations++;
+      }
+    }
+    std::ostringstream fields;
+    fields << "\"function\":\"" << entry.function << "\",\"range\":\"special values\",\"samples\":"
+           << specials.size()*specials.size() << ",\"violations\":" << violations;
+    passed &= report_check("fast_math", fields.str(), violations == 0);
+  }
+  return passed;
+}
+
+// Node noting whether two threads ever process it at the same time
+class OverlapProbe : public Node {
+  public:
+  static std::atomic<int> active;
+  static std::atomic<bool> overlapped;
+  OverlapProbe() : Node({SocketType::audio}, {SocketType::audio}, {}) {}
+  void process(NodeInputWindow&) override {
+    if (active.fetch_add(1) != 0) overlapped = true;
+    // Widen the window in which a second evaluation would show up
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+    active.fetch_sub(1);
+  }
+};
+std::atomic<int> OverlapProbe::active{0};
+std::atomic<bool> OverlapProbe::overlapped{false};
+
+// Render ahead switched on, resized and off while the device is running
+// and trees are being replaced: the tree must never be evaluated by two
+// threads at once (set SDL_AUDIODRIVER=dummy where there is no sound card)
+bool check_render_ahead() {
+  NodeTypeRegistration<OverlapProbe> registration("OverlapProbeNode");
+  audionodes_initialize();
+  if (audionodes_get_output_latency() == 0) {
+    return report_check("render_ahead", "\"skipped\":\"no audio device\"", true);
+  }
+  node_uid oscillator = audionodes_create_node("OscillatorNode");
+  node_uid probe = audionodes_create_node("OverlapProbeNode");
+  node_uid sink = audionodes_create_node("SinkNode");
+  audionodes_add_link(oscillator, probe, 0, 0);
+  audionodes_add_link(probe, sink, 0, 0);
+  OverlapProbe::overlapped = false;
+  const size_t switches = 200;
+  for (size_t i = 0; i < switches; ++i) {
+    audionodes_set_render_ahead(i % 3 == 0 ? 0 : i % 5 + 1);
+    if (i % 2) {
+      audionodes_remove_link(oscillator, probe, 0, 0);
+    } else {
+      audionodes_add_link(oscillator, probe, 0, 0);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  audionodes_set_render_ahead(0);
+  audionodes_cleanup();
+  std::ostringstream fields;
+  fields << "\"switches\":" << switches << ",\"overlapped\":" << (OverlapProbe::overlapped ? "true" : "false");
+  return report_check("render_ahead", fields.str(), !OverlapProbe::overlapped);
+}
+
+// Graph files with links between sockets the nodes don't have, or into
+// an already linked input, are rejected without touching the engine
+bool check_graph_files() {
+  const std::string path = "bench_check_graph.txt";
+  const std::string nodes = "node a OscillatorNode\nnode s SinkNode\n";
+  const std::vector<std::pair<std::string, bool>> cases = {
+    {"link a 0 s 0\n", true},
+    {"link a 0 s 5000\n", false},
+    {"link a 7 s 0\n", false},
+    {"node b OscillatorNode\nlink a 0 s 0\nlink b 0 s 0\n", false}
+  };
+  bool passed = true;
+  for (auto &test_case : cases) {
+    audionodes_initialize_offline();
+    {
+      std::ofstream file(path);
+      file << nodes << test_case.first;
+    }
+    bool loaded = audionodes_load_graph(path.c_str());
+    // Publishing and evaluating would read out of bounds on a bad link
+    Chunk buffer;
+    audionodes_render(buffer.data(), BLOCK_SIZE);
+    audionodes_cleanup();
+    std::string links = test_case.first;
+    std::replace(links.begin(), links.end(), '\n', ';');
+    std::ostringstream fields;
+    fields << "\"links\":\"" << links << "\",\"loaded\":" << (loaded ? "true" : "false");
+    passed &= report_check("graph_files", fields.str(), loaded == test_case.second);
+  }
+  std::remove(path.c_str());
+  return passed;
+}
+
+// Link edits naming sockets the nodes don't have are refused, a link
+// into an already linked input replaces the old link
+bool check_links() {
+  audionodes_initialize_offline();
+  node_uid a = audionodes_create_node("OscillatorNode");
+  node_uid b = audionodes_create_node("OscillatorNode");
+  node_uid sink = audionodes_create_node("SinkNode");
+  std::vector<std::pair<std::string, bool>> results;
+  results.emplace_back("input out of range", !audionodes_add_link(a, sink, 0, 5000));
+  results.emplace_back("output out of range", !audionodes_add_link(a, sink, 7, 0));
+  audionodes_add_link(a, sink, 0, 0);
+  results.emplace_back("replacing link added", audionodes_add_link(b, sink, 0, 0));
+  results.emplace_back("replaced link removed", !audionodes_remove_link(a, sink, 0, 0));
+  void *links = audionodes_begin_tree_update();
+  audionodes_add_tree_update_link(links, a, sink, 0, 0);
+  audionodes_add_tree_update_link(links, b, sink, 0, 0);
+  results.emplace_back("tree update linking an input twice", !audionodes_finish_tree_update(links));
+  node_uid filter = audionodes_create_node("IIRFilterNode");
+  audionodes_add_link(a, filter, 0, 1);
+  results.emplace_back("replacing node lacking a socket", !audionodes_replace_node(filter, audionodes_create_node("NoiseNode")));
+  Chunk buffer;
+  audionodes_render(buffer.data(), BLOCK_SIZE);
+  audionodes_cleanup();
+  bool passed = true;
+  for (auto &result : results) {
+    passed &= report_check("links", "\"case\":\"" + result.first + "\"", result.second);
+  }
+  return passed;
+}
+
+// Link edits while a pipeline of three stages runs: the new trees
+// continue with the blocks in flight. The edits only touch a silent
+// branch, so the output has to be the same as without them.
+bool check_pipeline_edits() {
+  const size_t edits = 16, blocks_per_edit = 4;
+  auto render = [&](bool with_edits) {
+    audionodes_initialize_offline();
+    // Stages running at the same time
+    audionodes_set_worker_threads(2);
+    audionodes_set_pipeline_stages(3);
+    node_uid previous = audionodes_create_node("OscillatorNode");
+    audionodes_update_node_input_value(previous, 0, 220);
+    audionodes_update_node_input_value(previous, 1, 1);
+    std::vector<node_uid> filters;
+    for (size_t i = 0; i < 6; ++i) {
+      node_uid filter = audionodes_create_node("IIRFilterNode");
+      audionodes_update_node_input_value(filter, 1, 2000);
+      audionodes_update_node_input_value(filter, 2, 0.7);
+      filters.push_back(filter);
+    }
+    node_uid sink = audionodes_create_node("SinkNode");
+    // Amplitude 0
+    node_uid silent = audionodes_create_node("OscillatorNode");
+    audionodes_begin_graph_edit();
+    for (node_uid filter : filters) {
+      audionodes_add_link(previous, filter, 0, 0);
+      previous = filter;
+    }
+    audionodes_add_link(previous, sink, 0, 0);
+    audionodes_end_graph_edit();
+    std::vector<SigT> output;
+    Chunk buffer;
+    for (size_t edit = 0; edit < edits; ++edit) {
+      if (with_edits && edit % 2 == 1) {
+        audionodes_add_link(silent, filters[0], 0, 3);
+      } else if (with_edits && edit > 0) {
+        audionodes_remove_link(silent, filters[0], 0, 3);
+      }
+      for (size_t i = 0; i < blocks_per_edit; ++i) {
+        audionodes_render(buffer.data(), BLOCK_SIZE);
+        output.insert(output.end(), buffer.begin(), buffer.begin()+BLOCK_SIZE);
+      }
+    }
+    audionodes_set_pipeline_stages(1);
+    audionodes_cleanup();
+    return output;
+  };
+  std::vector<SigT> reference = render(false), edited = render(true);
+  size_t silent_blocks = 0, differing_blocks = 0;
+  // The first blocks fill the pipeline
+  for (size_t block = 2; block < edits*blocks_per_edit; ++block) {
+    SigT peak = 0;
+    bool same = true;
+    for (size_t j = block*BLOCK_SIZE; j < (block+1)*BLOCK_SIZE; ++j) {
+      peak = std::max(peak, std::abs(edited[j]));
+      same &= same_sample(edited[j], reference[j]);
+    }
+    if (peak == 0) silent_blocks++;
+    if (!same) differing_blocks++;
+  }
+  std::ostringstream fields;
+  fields << "\"edits\":" << edits-1 << ",\"silent_blocks\":" << silent_blocks
+         << ",\"differing_blocks\":" << differing_blocks;
+  return report_check("pipeline_edits", fields.str(), silent_blocks == 0 && differing_blocks == 0);
+}
+
+// Overlapping chords, so that voices start and end while others play
+class ChordSource : public Node {
+  size_t block = 0;
+  public:
+  ChordSource() : Node({}, {SocketType::midi}, {}) {}
+  void process(NodeInputWindow&) override {
+    auto &events = output_window.get<MidiData>(0).events;
+    events.clear();
+    // Three notes every other block, each released 30 blocks later
+    const size_t length = 30;
+    auto note = [](size_t block, size_t k) { return 40+(block*7+k*11)%48; };
+    if (block % 2 == 0 && block < 200) {
+      for (size_t k = 0; k < 3; ++k) events.emplace_back(MidiData::EType::note_on, 0, note(block, k), 100);
+    }
+    if (block >= length && block % 2 == 0 && block < 200+length) {
+      for (size_t k = 0; k < 3; ++k) events.emplace_back(MidiData::EType::note_off, 0, note(block-length, k), 0);
+    }
+    block++;
+  }
+};
+
+// Chords through two filters, one with a cutoff shared by the voices
+// and moving every block and one following the note of each voice, and
+// a node reading the voices of the first one. Rendered with the voices
+// in lanes of each width, serially and split across workers, the output
+// has to be the same as with per-voice chunks.
+bool check_voice_lanes() {
+  NodeTypeRegistration<ChordSource> registration("ChordSourceNode");
+  auto render = [&](size_t lanes, size_t threads) {
+    audionodes_set_voice_lanes(lanes);
+    audionodes_initialize_offline();
+    audionodes_set_worker_threads(threads);
+    audionodes_set_voice_parallelism(threads ? 4 : 0);
+    node_uid chords = audionodes_create_node("ChordSourceNode");
+    node_uid piano = audionodes_create_node("PianoNode");
+    node_uid oscillator = audionodes_create_node("OscillatorNode");
+    node_uid lfo = audionodes_create_node("OscillatorNode");
+    node_uid sweeping = audionodes_create_node("IIRFilterNode");
+    node_uid tracking = audionodes_create_node("IIRFilterNode");
+    node_uid mix = audionodes_create_node("MathNode");
+    node_uid sink = audionodes_create_node("SinkNode");
+    audionodes_update_node_input_value(oscillator, 1, 0.2);
+    audionodes_update_node_property_value(oscillator, 0, 1);
+    audionodes_update_node_input_value(lfo, 0, 3);
+    audionodes_update_node_input_value(lfo, 1, 500);
+    audionodes_update_node_input_value(lfo, 2, 1500);
+    audionodes_update_node_property_value(sweeping, 1, 6);
+    audionodes_update_node_input_value(sweeping, 2, 0.8);
+    audionodes_update_node_input_value(sweeping, 3, 1);
+    audionodes_update_node_property_value(tracking, 1, 3);
+    audionodes_update_node_input_value(tracking, 2, 0.7);
+    audionodes_update_node_input_value(tracking, 3, 1);
+    audionodes_begin_graph_edit();
+    audionodes_add_link(chords, piano, 0, 0);
+    audionodes_add_link(piano, oscillator, 0, 0);
+    audionodes_add_link(oscillator, sweeping, 0, 0);
+    audionodes_add_link(lfo, sweeping, 0, 1);
+    audionodes_add_link(sweeping, tracking, 0, 0);
+    audionodes_add_link(piano, tracking, 0, 1);
+    audionodes_add_link(tracking, mix, 0, 0);
+    audionodes_add_link(sweeping, mix, 0, 1);
+    audionodes_add_link(mix, sink, 0, 0);
+    audionodes_end_graph_edit();
+    std::vector<SigT> output;
+    Chunk buffer;
+    for (size_t block = 0; block < 300; ++block) {
+      audionodes_render(buffer.data(), BLOCK_SIZE);
+      output.insert(output.end(), buffer.begin(), buffer.begin()+BLOCK_SIZE);
+    }
+    audionodes_cleanup();
+    audionodes_set_voice_lanes(0);
+    return output;
+  };
+  bool passed = true;
+  for (size_t threads : {0, 2}) {
+    std::vector<SigT> reference = render(0, threads);
+    SigT peak = 0;
+    for (SigT sample : reference) peak = std::max(peak, std::abs(sample));
+    for (size_t lanes : {4, 8, 16}) {
+      std::vector<SigT> output = render(lanes, threads);
+      size_t differing = 0;
+      for (size_t i = 0; i < output.size(); ++i) {
+        if (!same_sample(output[i], reference[i])) differing++;
+      }
+      std::ostringstream fields;
+      fields << "\"lanes\":" << lanes << ",\"worker_threads\":" << threads
+             << ",\"peak\":" << peak << ",\"differing_samples\":" << differing;
+      passed &= report_check("voice_lanes", fields.str(), peak > 0 && differing == 0);
+    }
+  }
+  return passed;
+}
+
+// process() of each node type with all audio inputs connected to
+// constant polyphonic data
+void bench_node_process() {
+  // These open audio/MIDI devices when created
+  const std::set<std::string> skipped = {"MicrophoneNode", "MidiInNode"};
+  for (auto &id_creator_pair : get_node_types()) {
+    if (skipped.count(id_creator_pair.first)) continue;
+    for (size_t voices : {1, 8, 64}) {
+      std::unique_ptr<Node> node(id_creator_pair.second());
+      Universe::Pointer universe(new Universe(false, voices));
+      size_t input_count = node->get_input_count();
+      std::vector<Data*> input_data(input_count, nullptr);
+      std::vector<Universe::Pointer> input_universes;
+      for (size_t i = 0; i < input_count; ++i) {
+        if (node->input_socket_types[i] == Node::SocketType::audio) {
+          Chunk value;
+          value.fill(0.5);
+          AudioData *data = new AudioData(AudioData::PolyList(voices, value));
+          data->mono = value;
+          input_data[i] = data;
+          input_universes.push_back(universe);
+        } else {
+          // Unconnected, the node reads empty dummy data
+          input_universes.emplace_back(new Universe());
+        }
+      }
+      Universe::Descriptor universes = node->infer_polyphony_operation(input_universes);
+      NodeInputWindow::SocketsList sockets;
+      for (size_t i = 0; i < input_count; ++i) {
+        sockets.emplace_back(input_data[i], *universes.input != *input_universes[i]);
+      }
+      NodeInputWindow window(sockets, universes);
+      node->mark_connected = true;
+      node->connect_callback();
+      double ns = measure([&]() {
+        node->apply_bundle_universe_changes(*universes.bundles);
+        node->process(window);
+      });
+      node->mark_connected = false;
+      node->disconnect_callback();
+      for (Data *data : input_data) delete data;
+      std::ostringstream fields;
+      fields << "\"node\":\"" << id_creator_pair.first << "\",\"voices\":" << voices;
+      report("node_process", fields.str(), ns, BLOCK_SIZE);
+    }
+  }
+}
+
+// Whole tree evaluation through the offline renderer
+void bench_tree_evaluate() {
+  // Serially and with a worker per additional core
+  std::vector<size_t> thread_options = {0};
+  unsigned cores = std::thread::hardware_concurrency();
+  if (cores > 1) thread_options.push_back(cores-1);
+  for (std::string shape : {"chain", "parallel"}) {
+    for (size_t size : {16, 128}) {
+      for (size_t threads : thread_options) {
+        audionodes_initialize_offline();
+        audionodes_set_worker_threads(threads);
+        void *links = audionodes_begin_tree_update();
+        if (shape == "chain") {
+          // Oscillator followed by a long chain of filters
+          node_uid previous = audionodes_create_node("OscillatorNode");
+          for (size_t i = 1; i < size; ++i) {
+            node_uid filter = audionodes_create_node("IIRFilterNode");
+            audionodes_add_tree_update_link(links, previous, filter, 0, 0);
+            previous = filter;
+          }
+          node_uid sink = audionodes_create_node("SinkNode");
+          audionodes_add_tree_update_link(links, previous, sink, 0, 0);
+        } else {
+          // Independent oscillator -> filter -> sink strands
+          for (size_t i = 0; i < size/2; ++i) {
+            node_uid oscillator = audionodes_create_node("OscillatorNode");
+            node_uid filter = audionodes_create_node("IIRFilterNode");
+            node_uid sink = audionodes_create_node("SinkNode");
+            audionodes_update_node_input_value(oscillator, 0, 110+i);
+            audionodes_add_tree_update_link(links, oscillator, filter, 0, 0);
+            audionodes_add_tree_update_link(links, filter, sink, 0, 0);
+          }
+        }
+        audionodes_finish_tree_update(links);
+        Chunk buffer;
+        double ns = measure([&]() { audionodes_render(buffer.data(), BLOCK_SIZE); });
+        audionodes_cleanup();
+        std::ostringstream fields;
+        fields << "\"shape\":\"" << shape << "\",\"nodes\":" << size << ",\"worker_threads\":" << threads;
+        report("tree_evaluate", fields.str(), ns, BLOCK_SIZE);
+      }
+    }
+  }
+}
+
+// Polyphonic source of a fixed amount of voices
+class VoiceSource : public Node {
+  Universe::Pointer universe;
+  public:
+  static size_t voices;
+  VoiceSource() : Node({}, {SocketType::audio}, {}), universe(new Universe(false, voices)) {}
+  Universe::Descriptor infer_polyphony_operation(std::vector<Universe::Pointer>) override {
+    Universe::Descriptor result;
+    result.set_all(universe);
+    return result;
+  }
+  void process(NodeInputWindow&) override {
+    AudioData::PolyWriter output(output_window[0], *universe);
+    for (size_t voice = 0; voice < voices; ++voice) {
+      for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        output[voice][i] = SigT((i*7+voice*13)%32)/16-1;
+      }
+    }
+  }
+};
+size_t VoiceSource::voices = 0;
+
+// A chain of filters over polyphonic input with the voices in per-voice
+// chunks (lanes 0) and interleaved in lanes of each width
+void bench_voice_lanes() {
+  NodeTypeRegistration<VoiceSource> registration("VoiceSourceNode");
+  const size_t chain = 4;
+  for (size_t voices : {16, 64}) {
+    for (size_t lanes : {0, 4, 8, 16}) {
+      VoiceSource::voices = voices;
+      audionodes_set_voice_lanes(lanes);
+      audionodes_initialize_offline();
+      void *links = audionodes_begin_tree_update();
+      node_uid previous = audionodes_create_node("VoiceSourceNode");
+      for (size_t i = 0; i < chain; ++i) {
+        node_uid filter = audionodes_create_node("IIRFilterNode");
+        audionodes_update_node_property_value(filter, 1, 6);
+        audionodes_update_node_input_value(filter, 1, 1000+500*i);
+        audionodes_add_tree_update_link(links, previous, filter, 0, 0);
+        previous = filter;
+      }
+      node_uid sink = audionodes_create_node("SinkNode");
+      audionodes_add_tree_update_link(links, previous, sink, 0, 0);
+      audionodes_finish_tree_update(links);
+      Chunk buffer;
+      double ns = measure([&]() { audionodes_render(buffer.data(), BLOCK_SIZE); });
+      audionodes_cleanup();
+      audionodes_set_voice_lanes(0);
+      std::ostringstream fields;
+      fields << "\"voices\":" << voices << ",\"filters\":" << chain << ",\"lanes\":" << lanes;
+      report("voice_lanes", fields.str(), ns, BLOCK_SIZE);
+    }
+  }
+}
+
+// Voices ending and starting every chunk
+void bench_universe_apply_delta() {
+  for (size_t voices : {8, 64}) {
+    Universe universe(true);
+    universe.begin_update();
+    for (size_t i = 0; i < voices; ++i) universe.add_channel();
+    std::vector<Chunk, AlignedAllocator<Chunk>> state;
+    universe.apply_delta(state);
+    size_t counter = 0;
+    double ns = measure([&]() {
+      universe.begin_update();
+      universe.remove_channel(counter++ % voices);
+      universe.add_channel();
+      universe.apply_delta(state);
+    });
+    std::ostringstream fields;
+    fields << "\"voices\":" << voices;
+    report("universe_apply_delta", fields.str(), ns);
+  }
+}
+
+template<typename T>
+void bench_circular_buffer(const std::string &element) {
+  static CircularBuffer<T, 1024> buffer;
+  T value = T();
+  double ns = measure([&]() {
+    buffer.push(value);
+    value = buffer.pop();
+  });
+  report("circular_buffer", "\"element\":\"" + element + "\"", ns);
+}
+
+// audionodes_finish_tree_update on a chain of nodes, with no changes and
+// with one link toggled each time
+void bench_tree_rebuild() {
+  for (size_t size : {10, 100, 1000}) {
+    for (bool toggle : {false, true}) {
+      // No execution thread, retired trees are freed immediately
+      std::vector<node_uid> nodes;
+      for (size_t i = 0; i < size; ++i) nodes.push_back(audionodes_create_node("MathNode"));
+      node_uid sink = audionodes_create_node("SinkNode");
+      bool toggled = false;
+      double ns = measure([&]() {
+        void *links = audionodes_begin_tree_update();
+        for (size_t i = 1; i < size; ++i) {
+          audionodes_add_tree_update_link(links, nodes[i-1], nodes[i], 0, 0);
+        }
+        if (toggled) audionodes_add_tree_update_link(links, nodes[0], nodes[size-1], 0, 1);
+        audionodes_add_tree_update_link(links, nodes[size-1], sink, 0, 0);
+        audionodes_finish_tree_update(links);
+        toggled = toggle && !toggled;
+      });
+      audionodes_cleanup();
+      std::ostringstream fields;
+      fields << "\"nodes\":" << size << ",\"changed\":" << (toggle ? "true" : "false");
+      report("tree_rebuild", fields.str(), ns);
+    }
+  }
+}
+
+// One link of a chain added and removed through the delta entry points
+void bench_link_delta() {
+  for (size_t size : {10, 100, 1000}) {
+    std::vector<node_uid> nodes;
+    for (size_t i = 0; i < size; ++i) nodes.push_back(audionodes_create_node("MathNode"));
+    node_uid sink = audionodes_create_node("SinkNode");
+    for (size_t i = 1; i < size; ++i) audionodes_add_link(nodes[i-1], nodes[i], 0, 0);
+    audionodes_add_link(nodes[size-1], sink, 0, 0);
+    bool linked = false;
+    double ns = measure([&]() {
+      if (linked) {
+        audionodes_remove_link(nodes[0], nodes[size-1], 0, 1);
+      } else {
+        audionodes_add_link(nodes[0], nodes[size-1], 0, 1);
+      }
+      linked = !linked;
+    });
+    audionodes_cleanup();
+    report("link_delta", "\"nodes\":" + std::to_string(size), ns);
+  }
+}
+
+// NodeTree construction for the chain of link_delta, from scratch and on
+// top of the previous tree as when publishing an edit
+void bench_tree_build() {
+  for (size_t size : {10, 100, 1000}) {
+    for (bool incremental : {false, true}) {
+      std::vector<std::unique_ptr<Node>> nodes;
+      std::vector<Node*> order;
+      for (size_t i = 0; i <= size; ++i) {
+        nodes.emplace_back(get_node_types().at(i < size ? "MathNode" : "SinkNode")());
+        order.push_back(nodes.back().get());
+      }
+      std::vector<std::vector<NodeTree::Link>> chain(size+1);
+      for (size_t i = 0; i <= size; ++i) {
+        chain[i].resize(order[i]->get_input_count());
+        if (i > 0) chain[i][0] = NodeTree::Link(true, i-1, 0);
+      }
+      std::vector<std::vector<NodeTree::Link>> toggled = chain;
+      toggled[size-1][1] = NodeTree::Link(true, 0, 0);
+      std::unique_ptr<NodeTree> tree(new NodeTree(order, chain));
+      bool linked = false;
+      double ns = measure([&]() {
+        linked = !linked;
+        tree.reset(new NodeTree(order, linked ? toggled : chain, incremental ? tree.get() : nullptr));
+      });
+      tree.reset();
+      std::ostringstream fields;
+      fields << "\"nodes\":" << size << ",\"incremental\":" << (incremental ? "true" : "false");
+      report("tree_build", fields.str(), ns);
+    }
+  }
+}
+
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1) filter = argv[1];
+  if (argc > 2) min_seconds = std::atof(argv[2]);
+  if (argc > 3 && !audionodes_set_block_size(std::atoi(argv[3]))) return 2;
+  bool passed = true;
+  if (enabled("check_kernels")) passed &= check_kernels();
+  if (enabled("check_fast_math")) passed &= check_fast_math();
+  if (enabled("check_render_ahead")) passed &= check_render_ahead();
+  if (enabled("check_graph_files")) passed &= check_graph_files();
+  if (enabled("check_links")) passed &= check_links();
+  if (enabled("check_pipeline_edits")) passed &= check_pipeline_edits();
+  if (enabled("check_voice_lanes")) passed &= check_voice_lanes();
+  if (enabled("kernels")) bench_kernels();
+  if (enabled("node_process")) bench_node_process();
+  if (enabled("tree_evaluate")) bench_tree_evaluate();
+  if (enabled("voice_lanes")) bench_voice_lanes();
+  if (enabled("universe_apply_delta")) bench_universe_apply_delta();
+  if (enabled("circular_buffer")) {
+    bench_circular_buffer<int>("int");
+    bench_circular_buffer<Chunk>("chunk");
+  }
+  if (enabled("tree_rebuild")) bench_tree_rebuild();
+  if (enabled("link_delta")) bench_link_delta();
+  if (enabled("tree_build")) bench_tree_build();
+  return passed ? 0 : 1;
+}
@@ -9,5 +9,32 @@ void audionodes_update_node_property_value(int, int, int);
 void audionodes_send_node_binary_data(int, int, int, void*);
 void* audionodes_begin_tree_update();
 void audionodes_add_tree_update_link(void*, int, int, size_t, size_t);
-void audionodes_finish_tree_update(void*);
-
+bool audionodes_finish_tree_update(void*);
+void audionodes_begin_graph_edit();
+void audionodes_end_graph_edit();
+bool audionodes_add_link(int, int, size_t, size_t);
+bool audionodes_remove_link(int, int, size_t, size_t);
+bool audionodes_replace_node(int, int);
+bool audionodes_save_graph(const char*);
+bool audionodes_load_graph(const char*);
+void audionodes_initialize_offline();
+size_t audionodes_render(float*, size_t);
+bool audionodes_render_to_file(const char*, double);
+bool audionodes_set_sample_rate(int);
+int audionodes_get_sample_rate();
+bool audionodes_set_block_size(size_t);
+size_t audionodes_get_block_size();
+bool audionodes_set_voice_lanes(size_t);
+size_t audionodes_get_voice_lanes();
+size_t audionodes_get_output_latency();
+void audionodes_set_render_ahead(size_t);
+size_t audionodes_get_xrun_count();
+void audionodes_get_engine_health(size_t*, size_t*, size_t*, size_t*, size_t*);
+size_t audionodes_get_callback_histogram(size_t*, size_t);
+void audionodes_reset_engine_health();
+bool audionodes_get_node_timing(int, size_t*, double*, double*, double*, double*, size_t*);
+void audionodes_reset_node_timing();
+void audionodes_set_worker_threads(size_t);
+void audionodes_set_voice_parallelism(size_t);
+void audionodes_set_pipeline_stages(size_t);
+void audionodes_get_control_stats(size_t*, size_t*);
@@ -0,0 +1,106 @@
+#include <cstddef>
+extern "C" {
+#include "c_interface.h"
+}
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+
+// Headless host for graph files (see util/graph_file.hpp), only uses the
+// C interface of the native library.
+//   audionodes_cli [options] render <graph> <output.wav> <seconds>
+//   audionodes_cli [options] bench <graph> <seconds>
+// Options: --rate=<Hz> --block-size=<samples> --threads=<worker threads>
+//          --voice-parallelism=<voices> --pipeline-stages=<stages>
+//          --voice-lanes=<0, 4, 8 or 16>
+
+namespace {
+
+int usage() {
+  std::cerr << "Usage: audionodes_cli [--rate=HZ] [--block-size=N] [--threads=N] [--voice-parallelism=N] [--pipeline-stages=N] [--voice-lanes=N]" << std::endl
+            << "         render <graph> <output.wav> <seconds>" << std::endl
+            << "       audionodes_cli [options] bench <graph> <seconds>" << std::endl;
+  return 2;
+}
+
+// Render as fast as possible and print statistics of the time per block
+// as JSON
+int bench(double seconds) {
+  size_t block = audionodes_get_block_size();
+  size_t blocks = std::max(1., seconds*audionodes_get_sample_rate()/block);
+  std::vector<float> buffer(block);
+  std::vector<double> times;
+  times.reserve(blocks);
+  for (size_t i = 0; i < blocks; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    audionodes_render(buffer.data(), block);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now()-start;
+    times.push_back(elapsed.count());
+  }
+  double total = 0;
+  for (double time : times) total += time;
+  std::sort(times.begin(), times.end());
+  double period = double(block)/audionodes_get_sample_rate();
+  std::cout << "{\"blocks\":" << blocks
+            << ",\"block_size\":" << block
+            << ",\"rate\":" << audionodes_get_sample_rate()
+            << ",\"realtime_factor\":" << period*blocks/total
+            << ",\"block_us_min\":" << times.front()*1e6
+            << ",\"block_us_mean\":" << total/blocks*1e6
+            << ",\"block_us_p99\":" << times[std::min(blocks-1, blocks*99/100)]*1e6
+            << ",\"block_us_max\":" << times.back()*1e6
+            << ",\"block_period_us\":" << period*1e6
+            << "}" << std::endl;
+  return 0;
+}
+
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> args;
+  int rate = 0;
+  size_t block_size = 0, threads = 0, voice_parallelism = 0, pipeline_stages = 1, voice_lanes = 0;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto option = [&arg](const std::string &name) {
+      return arg.compare(0, name.size(), name) == 0 ? arg.c_str()+name.size() : nullptr;
+    };
+    if (const char *value = option("--rate=")) rate = std::atoi(value);
+    else if (const char *value = option("--block-size=")) block_size = std::atoi(value);
+    else if (const char *value = option("--threads=")) threads = std::atoi(value);
+    else if (const char *value = option("--voice-parallelism=")) voice_parallelism = std::atoi(value);
+    else if (const char *value = option("--pipeline-stages=")) pipeline_stages = std::atoi(value);
+    else if (const char *value = option("--voice-lanes=")) voice_lanes = std::atoi(value);
+    else args.push_back(arg);
+  }
+  if (args.size() < 3) return usage();
+  const std::string &command = args[0], &graph = args[1];
+  if (!(command == "render" && args.size() == 4) && !(command == "bench" && args.size() == 3)) {
+    return usage();
+  }
+  
+  if (rate > 0) audionodes_set_sample_rate(rate);
+  if (block_size > 0 && !audionodes_set_block_size(block_size)) return 2;
+  if (!audionodes_set_voice_lanes(voice_lanes)) return 2;
+  audionodes_initialize_offline();
+  audionodes_set_worker_threads(threads);
+  audionodes_set_voice_parallelism(voice_parallelism);
+  audionodes_set_pipeline_stages(pipeline_stages);
+  if (!audionodes_load_graph(graph.c_str())) {
+    audionodes_cleanup();
+    return 1;
+  }
+  
+  int status;
+  if (command == "render") {
+    status = audionodes_render_to_file(args[2].c_str(), std::atof(args[3].c_str())) ? 0 : 1;
+  } else {
+    status = bench(std::atof(args[2].c_str()));
+  }
+  audionodes_cleanup();
+  return status;
+}
@@ -8,25 +8,84 @@
 #include <cmath>
 #include <algorithm>
 #include <cstdint>
+#include <type_traits>
 
 namespace audionodes {
 
-#ifdef __linux__
-constexpr size_t N = 256;
+// Supported block sizes: the engine runs at one of them, chosen before
+// initialization (audionodes_set_block_size) and constant while it runs.
+// A Chunk holds the largest one, N, which is set when building (CMake
+// option AUDIONODES_MAX_BLOCK_SIZE). Smaller blocks leave the rest of
+// every buffer unused, spreading the voices over more cache and memory.
+#ifndef AUDIONODES_MAX_BLOCK_SIZE
+#define AUDIONODES_MAX_BLOCK_SIZE 512
+#endif
+constexpr size_t N = AUDIONODES_MAX_BLOCK_SIZE;
+static_assert(N == 64 || N == 128 || N == 256 || N == 512, "Unsupported AUDIONODES_MAX_BLOCK_SIZE");
+#if defined(__linux__)
+constexpr size_t DEFAULT_BLOCK_SIZE = std::min<size_t>(256, N);
 #else
-constexpr size_t N = 512;
+constexpr size_t DEFAULT_BLOCK_SIZE = N;
 #endif
+extern size_t BLOCK_SIZE;
 
-constexpr int RATE = 44100;
+// Calls function with the block size as a std::integral_constant, so that
+// hot loops bounded by it get constant trip counts: one instantiation per
+// supported size, picked by the size the engine was initialized with
+template<class F>
+inline void with_block_size(F &&function) {
+  // Sizes above N are never set, the clamping only keeps them compiling
+  switch (BLOCK_SIZE) {
+    case 64: function(std::integral_constant<size_t, 64>()); break;
+    case 128: function(std::integral_constant<size_t, std::min<size_t>(128, N)>()); break;
+    case 256: function(std::integral_constant<size_t, std::min<size_t>(256, N)>()); break;
+    default: function(std::integral_constant<size_t, N>()); break;
+  }
+}
+inline bool is_supported_block_size(size_t size) {
+  return size <= N && (size == 64 || size == 128 || size == 256 || size == 512);
+}
+
+// Voices per group of the interleaved layout of polyphonic audio (see
+// AudioData::lanes), processed together in SIMD lanes by the nodes that
+// support it. 0 keeps each voice in a chunk of its own. Chosen before
+// initialization (audionodes_set_voice_lanes) and constant while it runs.
+extern size_t VOICE_LANES;
+
+// Calls function with VOICE_LANES as a std::integral_constant, like
+// with_block_size. Only called while it is set.
+template<class F>
+inline void with_voice_lanes(F &&function) {
+  switch (VOICE_LANES) {
+    case 8: function(std::integral_constant<size_t, 8>()); break;
+    case 16: function(std::integral_constant<size_t, 16>()); break;
+    default: function(std::integral_constant<size_t, 4>()); break;
+  }
+}
+inline bool is_supported_voice_lanes(size_t lanes) {
+  return lanes == 0 || lanes == 4 || lanes == 8 || lanes == 16;
+}
+
+// Sample rate, chosen before initialization (audionodes_set_sample_rate)
+// and constant while the engine runs
+extern int RATE;
+constexpr int DEFAULT_RATE = 44100;
 
 #ifndef M_PI
 constexpr double M_PI = 3.14159265358979323846;
 #endif
 
 typedef float SigT;
-typedef std::array<SigT, N> Chunk;
+constexpr size_t cache_line = 64;
+// Block of samples, aligned to a cache line so that vector loads never
+// straddle two lines (see util/kernels.hpp)
+struct alignas(cache_line) Chunk : std::array<SigT, N> {};
 typedef int node_uid;
 
+// Level below which decaying state (filter and delay tails) is treated
+// as silence, -100 dBFS
+constexpr SigT silence_threshold = 1e-5;
+
 }
 
 #endif
@@ -0,0 +1,64 @@
+#include "control_channel.hpp"
+
+namespace audionodes {
+
+ControlChannel::ControlChannel() :
+    coalesced_count(0),
+    dropped_count(0)
+{}
+
+template<typename T>
+bool ControlChannel::send(Node::PendingValue<T> &pending, Key key, T value) {
+  pending.value = value;
+  if (pending.dirty.exchange(true)) {
+    // Key already queued, the execution thread will pick up the new value
+    coalesced_count++;
+    return true;
+  }
+  if (changed.full()) {
+    pending.dirty = false;
+    dropped_count++;
+    return false;
+  }
+  changed.push(key);
+  return true;
+}
+
+bool ControlChannel::send_input(Node *node, size_t slot, SigT value) {
+  return send(node->pending_input_values[slot], {node, slot, false}, value);
+}
+
+bool ControlChannel::send_property(Node *node, size_t slot, int value) {
+  return send(node->pending_property_values[slot], {node, slot, true}, value);
+}
+
+size_t ControlChannel::get_queue_depth() {
+  return changed.size();
+}
+
+size_t ControlChannel::get_coalesced_count() {
+  return coalesced_count;
+}
+
+size_t ControlChannel::get_dropped_count() {
+  return dropped_count;
+}
+
+void ControlChannel::apply_pending() {
+  while (!changed.empty()) {
+    Key key = changed.pop();
+    // Clear the flag before reading, so that a value stored in between
+    // gets queued again instead of lost
+    if (key.property) {
+      Node::PendingValue<int> &pending = key.node->pending_property_values[key.slot];
+      pending.dirty = false;
+      key.node->set_property_value(key.slot, pending.value);
+    } else {
+      Node::PendingValue<SigT> &pending = key.node->pending_input_values[key.slot];
+      pending.dirty = false;
+      key.node->set_input_value(key.slot, pending.value);
+    }
+  }
+}
+
+}
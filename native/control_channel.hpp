@@ -0,0 +1,47 @@
+
+#ifndef CONTROL_CHANNEL_HPP
+#define CONTROL_CHANNEL_HPP
+
+#include "common.hpp"
+#include "node.hpp"
+#include "util/circular_buffer.hpp"
+
+#include <atomic>
+
+namespace audionodes {
+
+// Input and property updates from the UI thread to the execution thread.
+// Only the latest value per (node, slot) is kept: the value lives in the
+// node (Node::PendingValue) and the queue only carries the keys of slots
+// that have changed since the execution thread last looked at them.
+// Sending never blocks.
+class ControlChannel {
+  struct Key {
+    Node *node;
+    size_t slot;
+    bool property;
+  };
+  static const size_t capacity = 1024;
+  CircularBuffer<Key, capacity> changed;
+  std::atomic<size_t> coalesced_count, dropped_count;
+  template<typename T>
+  bool send(Node::PendingValue<T>&, Key, T);
+  
+  public:
+  // Sender (UI thread), false if the update had to be dropped
+  bool send_input(Node*, size_t, SigT);
+  bool send_property(Node*, size_t, int);
+  size_t get_queue_depth();
+  // Updates that replaced a value not yet applied
+  size_t get_coalesced_count();
+  // Updates lost because too many slots changed at once
+  size_t get_dropped_count();
+  // Call from the execution thread
+  void apply_pending();
+  
+  ControlChannel();
+};
+
+}
+
+#endif
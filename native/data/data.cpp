@@ -1,50 +1,154 @@
 #include "data/data.hpp"
+#include "polyphony.hpp"
+#include "util/kernels.hpp"
+#include <thread>
 
 namespace audionodes {
 
+const Data::Type Data::type_tag;
+Data::Data(Type type) : type(type) {}
 Data::~Data() {}
 Data Data::dummy = Data();
 
 void AudioData::make_collapsed_version() {
-  mono.fill(0);
-  for (const Chunk &channel : poly) {
-    for (size_t i = 0; i < N; ++i) {
-      mono[i] += channel[i];
+  kernels::fill(mono, 0);
+  for (size_t channel = 0; channel < poly.size(); ++channel) {
+    if (voices && !voices->is_active(channel)) continue;
+    kernels::add(mono, poly[channel]);
+  }
+}
+
+const Data::Type AudioData::type_tag;
+
+template<class F>
+void AudioData::ensure_fresh(std::atomic<DerivedState> &state, F compute) {
+  if (state.load(std::memory_order_acquire) == DerivedState::fresh) return;
+  DerivedState expected = DerivedState::stale;
+  if (state.compare_exchange_strong(expected, DerivedState::computing, std::memory_order_acquire)) {
+    compute();
+    state.store(DerivedState::fresh, std::memory_order_release);
+  } else {
+    // Another reader is computing it right now
+    while (state.load(std::memory_order_acquire) != DerivedState::fresh) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void AudioData::ensure_collapsed() {
+  ensure_fresh(collapse_state, [this]() {
+    ensure_voices();
+    make_collapsed_version();
+  });
+}
+
+void AudioData::make_voices() {
+  poly.resize(lane_slots);
+  for (size_t channel = 0; channel < lane_slots; ++channel) {
+    if (voices && !voices->is_active(channel)) continue;
+    const SigT *group = lane_group(channel/lane_width) + channel%lane_width;
+    Chunk &voice = poly[channel];
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+      voice[i] = group[i*lane_width];
     }
   }
 }
 
-AudioData::AudioData(bool init, size_t reserve) {
+void AudioData::ensure_voices() {
+  ensure_fresh(voices_state, [this]() { make_voices(); });
+}
+
+AudioData::AudioData(bool init, size_t reserve) :
+  Data(type_tag)
+{
   if (init) mono.fill(0);
   poly.reserve(reserve);
 }
 
 AudioData::AudioData(PolyList poly) :
+  Data(type_tag),
   poly(poly)
 {
   make_collapsed_version();
 }
 
 AudioData::AudioData(Chunk mono) :
+  Data(type_tag),
   mono(mono)
 {}
 
-AudioData AudioData::dummy = AudioData();
+AudioData AudioData::dummy;
 
 AudioData::PolyWriter::PolyWriter(AudioData &bind) :
   bind(bind),
   internal(bind.poly)
-{}
+{
+  bind.voices = nullptr;
+  bind.hold_poly();
+}
 
 AudioData::PolyWriter::PolyWriter(AudioData &bind, size_t size) :
   bind(bind),
   internal(bind.poly)
 {
+  bind.voices = nullptr;
+  bind.hold_poly();
   resize(size);
 }
 
+void AudioData::copy_block(const AudioData &other, const Universe *universe) {
+  mono = other.mono;
+  voices = other.voices ? universe : nullptr;
+  constant = other.constant;
+  silent = other.silent;
+  collapse_state.store(other.collapse_state.load(std::memory_order_acquire), std::memory_order_relaxed);
+  if (other.lane_width) {
+    // poly is derived again if needed
+    lanes.assign(other.lanes.begin(), other.lanes.begin()+(other.lane_slots+other.lane_width-1)/other.lane_width*BLOCK_SIZE*other.lane_width);
+    lane_width = other.lane_width;
+    lane_slots = other.lane_slots;
+    voices_state.store(DerivedState::stale, std::memory_order_relaxed);
+  } else {
+    poly = other.poly;
+    hold_poly();
+  }
+}
+
+void AudioData::begin_poly(const Universe &universe) {
+  voices = &universe;
+  hold_poly();
+  poly.resize(universe.get_channel_amount());
+}
+
+void AudioData::end_poly() {
+  collapse_state.store(DerivedState::stale, std::memory_order_relaxed);
+  // No voices, the collapsed version is all zeros
+  if (poly.empty()) set_constant(true);
+}
+
+void AudioData::begin_lanes(const Universe &universe, size_t width) {
+  voices = &universe;
+  lane_width = width;
+  lane_slots = universe.get_channel_amount();
+  size_t groups = (lane_slots+width-1)/width;
+  if (lanes.size() < groups*BLOCK_SIZE*width) lanes.resize(groups*BLOCK_SIZE*width);
+}
+
+void AudioData::end_lanes() {
+  voices_state.store(DerivedState::stale, std::memory_order_relaxed);
+  collapse_state.store(DerivedState::stale, std::memory_order_relaxed);
+  if (lane_slots == 0) set_constant(true);
+}
+
+AudioData::PolyWriter::PolyWriter(AudioData &bind, const Universe &universe) :
+  bind(bind),
+  internal(bind.poly)
+{
+  bind.begin_poly(universe);
+}
+
 AudioData::PolyWriter::~PolyWriter() {
-  bind.make_collapsed_version();
+  bind.end_poly();
 }
 
 }
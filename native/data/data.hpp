@@ -3,18 +3,34 @@
 #define DATA_HPP
 
 #include "common.hpp"
+#include "util/aligned_allocator.hpp"
 #include <map>
+#include <atomic>
 
 namespace audionodes {
 
-struct Data {
+class Universe;
+
+// Allocated cache line aligned for the chunks of audio data
+struct Data : public CacheAligned {
+  // Tag of the concrete type, checked instead of RTTI
+  enum class Type {
+    none, audio, midi, trigger
+  };
+  const Type type;
+  static const Type type_tag = Type::none;
+  Data(Type type = Type::none);
   virtual ~Data();
 
+  template<class T>
+  static bool holds(const Data* data) {
+    return data != nullptr && (T::type_tag == Type::none || data->type == T::type_tag);
+  }
+
   template<class T>
   static T& extract(Data* data) {
-    T *p = dynamic_cast<T*>(data);
-    if (p != nullptr) {
-      return *p;
+    if (holds<T>(data)) {
+      return static_cast<T&>(*data);
     } else {
       // Data-object doesn't contain T, return empty dummy T instead
       return T::dummy;
@@ -23,9 +39,8 @@ struct Data {
 
   template<class T>
   static const T& extract(const Data* data) {
-    const T *p = dynamic_cast<const T*>(data);
-    if (p != nullptr) {
-      return *p;
+    if (holds<T>(data)) {
+      return static_cast<const T&>(*data);
     } else {
       return T::dummy;
     }
@@ -35,18 +50,84 @@ struct Data {
 };
 
 struct AudioData : public Data {
+  static const Type type_tag = Type::audio;
+  // Collapsed version of poly, only valid after ensure_collapsed if
+  // written through a PolyWriter
   Chunk mono;
-  typedef std::vector<Chunk> PolyList;
+  typedef std::vector<Chunk, AlignedAllocator<Chunk>> PolyList;
   static const size_t default_reserve = 16;
   PolyList poly;
+  // Slots of poly holding a voice, all of them if null. Inactive slots
+  // hold no meaningful data.
+  const Universe *voices = nullptr;
+  // Interleaved voices, written instead of poly by nodes processing
+  // voice lanes (see VOICE_LANES): group g holds the slots g*L..g*L+L-1
+  // as BLOCK_SIZE samples of L lanes, voice innermost. Only valid while
+  // lane_width (L) is nonzero, poly is derived from it by ensure_voices.
+  typedef std::vector<SigT, AlignedAllocator<SigT>> LaneList;
+  LaneList lanes;
+  size_t lane_width = 0;
+  inline SigT* lane_group(size_t group) {
+    return lanes.data() + group*BLOCK_SIZE*lane_width;
+  }
+  inline const SigT* lane_group(size_t group) const {
+    return lanes.data() + group*BLOCK_SIZE*lane_width;
+  }
+  // Amount of slots in the block, whichever layout holds it
+  inline size_t get_slot_amount() const {
+    return lane_width ? lane_slots : poly.size();
+  }
+  // Properties of the current block, set by the producer: constant means
+  // that every chunk (mono and each voice) holds a single value, silent
+  // that all of them are zero. Cleared before the producer is processed.
+  bool constant = false, silent = false;
+  inline void set_constant(bool is_silent = false) {
+    constant = true;
+    silent = is_silent;
+  }
+  inline void clear_flags() {
+    constant = silent = false;
+  }
   void make_collapsed_version();
+  // Computes mono from poly if it is out of date, at most once per write.
+  // Safe to call from several readers at once.
+  void ensure_collapsed();
+  // Fills poly from the interleaved voices if they hold the block, at
+  // most once per write. Safe to call from several readers at once.
+  void ensure_voices();
   AudioData(bool init = false, size_t reserve = default_reserve);
   AudioData(PolyList);
   AudioData(Chunk);
   static AudioData dummy;
   
-  // Interface object to write polyphonic data, computes collapsed version
-  // on destruction
+  // Mono-only output, drops whatever polyphonic data was left in the
+  // (possibly shared) buffer
+  inline Chunk& write_mono() {
+    poly.clear();
+    hold_poly();
+    collapse_state.store(DerivedState::fresh, std::memory_order_relaxed);
+    return mono;
+  }
+  
+  // Take over the block held by other, of which the voices are described
+  // by the given universe instead (a copy of the original one)
+  void copy_block(const AudioData&, const Universe*);
+  
+  // Start a polyphonic write sized to the slots of the universe, of which
+  // only the active ones have to be written. Must be followed by end_poly.
+  void begin_poly(const Universe&);
+  // Marks the collapsed version out of date
+  void end_poly();
+  
+  // Start an interleaved write of the slots of the universe in groups of
+  // the given width. Every lane of each group has to be written, the
+  // inactive ones with zeros. Must be followed by end_lanes.
+  void begin_lanes(const Universe&, size_t width);
+  // Marks poly and the collapsed version out of date
+  void end_lanes();
+  
+  // Interface object to write polyphonic data, marks the collapsed version
+  // out of date on destruction
   class PolyWriter {
     AudioData &bind;
     public:
@@ -59,8 +140,28 @@ struct AudioData : public Data {
     }
     PolyWriter(AudioData&);
     PolyWriter(AudioData&, size_t);
+    // Sized to the slots of the universe, of which only the active ones
+    // have to be written
+    PolyWriter(AudioData&, const Universe&);
     ~PolyWriter();
   };
+  
+  private:
+  size_t lane_slots = 0;
+  inline void hold_poly() {
+    lane_width = 0;
+    voices_state.store(DerivedState::fresh, std::memory_order_relaxed);
+  }
+  void make_voices();
+  // Whether a derived version (mono, or poly from lanes) is up to date
+  enum class DerivedState : unsigned char {
+    fresh, stale, computing
+  };
+  std::atomic<DerivedState> collapse_state{DerivedState::fresh};
+  std::atomic<DerivedState> voices_state{DerivedState::fresh};
+  // Runs compute if state is stale, other callers wait for it
+  template<class F>
+  static void ensure_fresh(std::atomic<DerivedState>&, F compute);
 };
 
 }
@@ -71,11 +71,14 @@ MidiData::Event::Event(
 
 MidiData::Event::Event() {}
 
+const Data::Type MidiData::type_tag;
+
 MidiData::MidiData(EventSeries events) :
+  Data(type_tag),
   events(events)
 {}
 
-MidiData::MidiData() {}
+MidiData::MidiData() : Data(type_tag) {}
 
 MidiData MidiData::dummy = MidiData();
 
@@ -7,6 +7,7 @@
 namespace audionodes {
 
 struct MidiData : public Data {
+  static const Type type_tag = Type::midi;
   struct Event {
     enum class Type {
       note_off = 0x8,
@@ -2,10 +2,13 @@
 
 namespace audionodes {
 
+const Data::Type TriggerData::type_tag;
+
 TriggerData::TriggerData(EventSeries events) :
+    Data(type_tag),
     events(events)
 {}
-TriggerData::TriggerData() {}
+TriggerData::TriggerData() : Data(type_tag) {}
 
 TriggerData TriggerData::dummy = TriggerData();
 
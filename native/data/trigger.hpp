@@ -7,6 +7,7 @@
 namespace audionodes {
 
 struct TriggerData : public Data {
+  static const Type type_tag = Type::trigger;
   typedef size_t Event;
   typedef std::vector<Event> EventSeries;
   EventSeries events;
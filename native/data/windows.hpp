@@ -9,6 +9,8 @@
 
 namespace audionodes {
 
+class WorkerPool;
+
 class NodeInputWindow {
   public:
   class Socket {
@@ -16,55 +18,102 @@ class NodeInputWindow {
     friend class NodeTree;
     
     bool view_collapsed;
-    AudioData *audio_cache = nullptr;
-    Data *audio_cache_valid_for = nullptr;
-    Data **data;
+    // Both resolved when the socket is created, audio points to the
+    // dummy if the data isn't audio
+    Data *data;
+    AudioData *audio;
+    // Inline value of an unconnected input, owned by the window
     const bool tmp_audio_data;
-    void delete_temporary_data();
     
     template<class T>
     inline T& get_write() {
-      return Data::extract<T>(data ? *data : nullptr);
+      return Data::extract<T>(data);
     }
     
     public:
-    Socket(Data**, bool, bool tmp_audio_data=false);
+    Socket(Data*, bool, bool tmp_audio_data=false);
     template<class T = Data>
     inline const T& get() {
       return get_write<T>();
     }
-    const Chunk& operator[](size_t idx);
+    // Block properties of the data, see AudioData
+    inline bool is_constant() const {
+      return audio->constant;
+    }
+    inline bool is_silent() const {
+      return audio->silent;
+    }
+    // Brings the collapsed version up to date if the node may read it
+    // when reading the given amount of channels, and the voices unless
+    // the node reads them interleaved
+    inline void prepare(size_t channels, bool reads_lanes = false) {
+      if (!reads_lanes) audio->ensure_voices();
+      if (view_collapsed || audio->get_slot_amount() < std::max<size_t>(channels, 1)) {
+        audio->ensure_collapsed();
+      }
+    }
+    // The interleaved voices if the data holds them in groups of the given
+    // width, nullptr otherwise (see AudioData::lanes)
+    inline const SigT* get_lanes(size_t width) const {
+      return !view_collapsed && audio->lane_width == width ? audio->lanes.data() : nullptr;
+    }
+    inline const Chunk& operator[](size_t idx) {
+      if (view_collapsed || idx >= audio->poly.size()) {
+        return audio->mono;
+      } else {
+        return audio->poly[idx];
+      }
+    }
   };
   typedef std::vector<Socket> SocketsList;
   private:
   SocketsList sockets;
+  // The inline values, shared by copies of the window
+  std::vector<std::shared_ptr<Data>> temporaries;
   public:
   Universe::Descriptor universes;
+  // Pool of the evaluating NodeTree, nullptr when evaluated serially
+  WorkerPool *pool = nullptr;
   size_t get_channel_amount();
+  // Whether channel holds a voice, inactive channels are skipped
+  inline bool is_active(size_t channel) {
+    return universes.input->is_active(channel);
+  }
+  // Takes ownership of the temporary data of the sockets
   NodeInputWindow(SocketsList, Universe::Descriptor);
   inline Socket& operator[](size_t idx) {
     return sockets[idx];
   }
-  ~NodeInputWindow();
 };
 
 class NodeOutputWindow {
+  // Data currently written to, the node's own sockets unless bound
+  Data *const *bound = nullptr;
+  inline Data* active(size_t idx) {
+    return bound ? bound[idx] : sockets[idx];
+  }
   public:
-  typedef std::vector<Data**> SocketsList;
+  typedef std::vector<Data*> SocketsList;
   
   NodeOutputWindow();
   ~NodeOutputWindow();
   template<class T>
   inline T& get(size_t idx) {
-    return Data::extract<T>(*sockets[idx]);
+    return Data::extract<T>(active(idx));
   }
   // Specialization of get for AudioData
   inline AudioData& operator[](size_t idx) {
-    return Data::extract<AudioData>(*sockets[idx]);
+    return Data::extract<AudioData>(active(idx));
   }
-  inline Data** ref(size_t idx) {
+  inline Data* ref(size_t idx) {
     return idx < sockets.size() ? sockets[idx] : nullptr;
   }
+  // Write to the given data (one per socket) instead of the own sockets,
+  // nullptr unbinds
+  inline void bind(Data *const *data) {
+    bound = data;
+  }
+  // Owned data of each socket
   SocketsList sockets;
 };
 
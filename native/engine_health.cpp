@@ -0,0 +1,61 @@
+#include "engine_health.hpp"
+
+namespace audionodes {
+
+const size_t EngineHealth::histogram_size;
+
+EngineHealth& get_engine_health() {
+  static EngineHealth health;
+  return health;
+}
+
+void EngineHealth::record_callback(double load) {
+  size_t bucket = std::min(size_t(std::max(load, 0.)*10), histogram_size-1);
+  callback_histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+  if (load >= 1) overruns.fetch_add(1, std::memory_order_relaxed);
+}
+
+void EngineHealth::record_xrun() {
+  xruns.fetch_add(1, std::memory_order_relaxed);
+}
+
+void EngineHealth::record_queue_depth(size_t depth) {
+  size_t current = queue_high_water.load(std::memory_order_relaxed);
+  while (depth > current && !queue_high_water.compare_exchange_weak(current, depth, std::memory_order_relaxed));
+}
+
+void EngineHealth::record_dropped_message() {
+  dropped_messages.fetch_add(1, std::memory_order_relaxed);
+}
+
+void EngineHealth::record_midi_overflow() {
+  midi_overflows.fetch_add(1, std::memory_order_relaxed);
+}
+
+EngineHealth::Snapshot EngineHealth::get_snapshot() const {
+  Snapshot snapshot;
+  for (size_t i = 0; i < histogram_size; ++i) {
+    snapshot.callback_histogram[i] = callback_histogram[i].load(std::memory_order_relaxed);
+  }
+  snapshot.overruns = overruns.load(std::memory_order_relaxed);
+  snapshot.xruns = xruns.load(std::memory_order_relaxed);
+  snapshot.queue_high_water = queue_high_water.load(std::memory_order_relaxed);
+  snapshot.dropped_messages = dropped_messages.load(std::memory_order_relaxed);
+  snapshot.midi_overflows = midi_overflows.load(std::memory_order_relaxed);
+  return snapshot;
+}
+
+void EngineHealth::reset() {
+  for (auto &bucket : callback_histogram) bucket = 0;
+  overruns = 0;
+  xruns = 0;
+  queue_high_water = 0;
+  dropped_messages = 0;
+  midi_overflows = 0;
+}
+
+EngineHealth::EngineHealth() {
+  reset();
+}
+
+}
@@ -0,0 +1,51 @@
+
+#ifndef ENGINE_HEALTH_HPP
+#define ENGINE_HEALTH_HPP
+
+#include "common.hpp"
+#include <atomic>
+
+namespace audionodes {
+
+// Counters describing how well the engine keeps up, updated lock-free
+// from the audio, MIDI and UI threads and read/reset through the C API
+class EngineHealth {
+  public:
+  // Callback durations relative to the duration of the audio they
+  // produced, in buckets of 10 %; the last one collects 100 % and above
+  static const size_t histogram_size = 11;
+  struct Snapshot {
+    size_t callback_histogram[histogram_size];
+    // Callbacks that took longer than the audio they produced
+    size_t overruns;
+    // Chunks the render thread didn't have ready in time
+    size_t xruns;
+    // Deepest the message queues to the execution thread have been
+    size_t queue_high_water;
+    // Messages lost because a queue was full
+    size_t dropped_messages;
+    // Events lost because a MIDI input buffer was full
+    size_t midi_overflows;
+  };
+  
+  private:
+  std::atomic<size_t> callback_histogram[histogram_size];
+  std::atomic<size_t> overruns, xruns, queue_high_water, dropped_messages, midi_overflows;
+  
+  public:
+  void record_callback(double load);
+  void record_xrun();
+  void record_queue_depth(size_t);
+  void record_dropped_message();
+  void record_midi_overflow();
+  Snapshot get_snapshot() const;
+  // Counts racing with a reset may survive it
+  void reset();
+  EngineHealth();
+};
+
+EngineHealth& get_engine_health();
+
+}
+
+#endif
@@ -14,18 +14,21 @@ Node::Node(
     _property_types(property_types),
     input_socket_types(_input_socket_types),
     output_socket_types(_output_socket_types),
-    property_types(_property_types)
+    property_types(_property_types),
+    pending_input_values(new PendingValue<SigT>[input_types.size()]),
+    pending_property_values(new PendingValue<int>[property_types.size()])
 {
   input_values.resize(input_types.size());
   old_input_values.resize(input_types.size());
   property_values.resize(property_types.size());
-  output_window.sockets.reserve(input_types.size());
+  output_window.sockets.reserve(output_types.size());
   for (auto type : output_types) {
     Data *data = nullptr;
     switch (type) {
       typedef SocketType ST;
       case ST::audio:
-        data = new AudioData();
+        // Trees bind pooled buffers, this is only written outside of them
+        data = new AudioData(false, 0);
         break;
       case ST::midi:
         data = new MidiData();
@@ -34,13 +37,26 @@ Node::Node(
         data = new TriggerData();
         break;
     }
-    Data **data_ptr = new Data*(data);
-    output_window.sockets.push_back(data_ptr);
+    output_window.sockets.push_back(data);
   }
 }
 
 Node::~Node() {}
 
+static PoolAllocator& get_node_arena() {
+  // Never destroyed, nodes may still be deleted during static destruction
+  static PoolAllocator *arena = new PoolAllocator();
+  return *arena;
+}
+
+void* Node::operator new(size_t size) {
+  return get_node_arena().allocate(size);
+}
+
+void Node::operator delete(void *pointer, size_t size) {
+  get_node_arena().deallocate(pointer, size);
+}
+
 bool Node::get_is_sink() { return is_sink; }
 size_t Node::get_input_count() { return input_socket_types.size(); }
 
@@ -65,6 +81,12 @@ void Node::copy_input_values(const Node &old_node) {
   input_values = old_node.input_values;
   old_input_values = old_node.old_input_values;
   property_values = old_node.property_values;
+  for (size_t i = 0; i < input_values.size(); ++i) {
+    pending_input_values[i].value = old_node.pending_input_values[i].value.load();
+  }
+  for (size_t i = 0; i < property_values.size(); ++i) {
+    pending_property_values[i].value = old_node.pending_property_values[i].value.load();
+  }
 }
 
 Universe::Descriptor Node::infer_polyphony_operation(std::vector<Universe::Pointer> inputs) {
@@ -82,4 +104,72 @@ Universe::Descriptor Node::infer_polyphony_operation(std::vector<Universe::Point
 
 void Node::apply_bundle_universe_changes(const Universe&) {}
 
+bool Node::is_at_rest(NodeInputWindow&) {
+  return false;
+}
+
+VoiceNode* Node::as_voice_node() {
+  return nullptr;
+}
+
+bool Node::reads_voice_lanes(size_t) {
+  return false;
+}
+
+const size_t VoiceNode::batch_size;
+
+VoiceNode* VoiceNode::as_voice_node() {
+  return this;
+}
+
+void VoiceNode::begin_outputs(NodeInputWindow &input) {
+  for (size_t i = 0; i < output_socket_types.size(); ++i) {
+    if (output_socket_types[i] == SocketType::audio) {
+      output_window[i].begin_poly(*input.universes.output);
+    }
+  }
+}
+
+void VoiceNode::end_outputs() {
+  for (size_t i = 0; i < output_socket_types.size(); ++i) {
+    if (output_socket_types[i] == SocketType::audio) {
+      output_window[i].end_poly();
+    }
+  }
+}
+
+void VoiceNode::begin_voices(NodeInputWindow&) {}
+
+void VoiceNode::process_voices(NodeInputWindow &input, const size_t *voices, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    process_voice(input, voices[i]);
+  }
+}
+
+void VoiceNode::process_voice(NodeInputWindow&, size_t) {}
+
+void VoiceNode::end_voices(NodeInputWindow&) {}
+
+bool VoiceNode::processes_voice_lanes() {
+  return false;
+}
+
+void VoiceNode::process(NodeInputWindow &input) {
+  size_t n = input.get_channel_amount();
+  active_voices.clear();
+  for (size_t i = 0; i < n; ++i) {
+    if (input.is_active(i)) active_voices.push_back(i);
+  }
+  size_t batches = (active_voices.size()+batch_size-1)/batch_size;
+  begin_outputs(input);
+  begin_voices(input);
+  for_each_index(input, batches, active_voices.size(), [&](size_t batch) {
+    size_t begin = batch*batch_size;
+    process_voices(input, &active_voices[begin],
+      std::min(batch_size, active_voices.size()-begin));
+  });
+  end_voices(input);
+  end_outputs();
+}
+
 }
@@ -5,17 +5,46 @@
 #include "common.hpp"
 #include "polyphony.hpp"
 #include "data/windows.hpp"
+#include "worker_pool.hpp"
+#include "util/timing_stats.hpp"
+#include "util/pool_allocator.hpp"
 #include <mutex>
 #include <functional>
 #include <map>
+#include <atomic>
+#include <memory>
 
 namespace audionodes {
 
+class VoiceNode;
 
 class Node {
   protected:
   bool is_sink;
   
+  // Call function(i) for each i in [0, n), split across the worker pool
+  // when per-voice parallelism is enabled for the given amount of voices
+  template<class F>
+  void for_each_index(NodeInputWindow &input, size_t n, size_t voices, F function) {
+    if (input.pool && input.pool->should_split_voices(voices)) {
+      input.pool->parallel_for(n, function);
+    } else {
+      for (size_t i = 0; i < n; ++i) {
+        function(i);
+      }
+    }
+  }
+  
+  // Call function(i) for each active voice among the n channels. The voices
+  // are split across the worker pool if per-voice parallelism is enabled,
+  // so function may only touch state belonging to voice i.
+  template<class F>
+  void for_each_voice(NodeInputWindow &input, size_t n, F function) {
+    for_each_index(input, n, n, [&input, &function](size_t i) {
+      if (input.is_active(i)) function(i);
+    });
+  }
+  
   public:
   enum class SocketType {
     audio, midi, trigger
@@ -38,7 +67,13 @@ class Node {
   // Override if the node has to manage bundles
   virtual void apply_bundle_universe_changes(const Universe&);
   
-  bool mark_deletion = false, mark_connected = false, _tmp_connected = false;
+  bool mark_deletion = false, _tmp_connected = false;
+  // Set while a published tree may still evaluate the node, read by the
+  // execution and device threads
+  std::atomic<bool> mark_connected{false};
+  // Nonzero while a disconnection waits for the execution thread to be
+  // done with the old trees (see publish_graph)
+  uint64_t _pending_disconnect = 0;
   
   bool get_is_sink();
   size_t get_input_count();
@@ -52,6 +87,17 @@ class Node {
   std::vector<SigT> old_input_values;
   std::vector<int> property_values;
   
+  // Latest value sent to an input/property while the node is connected,
+  // handed to the execution thread through ControlChannel
+  template<typename T>
+  struct PendingValue {
+    std::atomic<T> value;
+    std::atomic<bool> dirty;
+    PendingValue() : value(T()), dirty(false) {}
+  };
+  std::unique_ptr<PendingValue<SigT>[]> pending_input_values;
+  std::unique_ptr<PendingValue<int>[]> pending_property_values;
+  
   // Called right before the node becomes active in a tree
   virtual void connect_callback();
   // Called after the node has become inactive (process no longer called)
@@ -59,13 +105,61 @@ class Node {
   
   void copy_input_values(const Node&);
   NodeOutputWindow output_window;
+  // Time spent in process, recorded by NodeTree
+  TimingStats timing;
   virtual void process(NodeInputWindow&) = 0;
+  // Override for stateful nodes: true if the state has fully decayed and
+  // the inputs are silent, process is then skipped for the block and the
+  // audio outputs are silent. Called after apply_bundle_universe_changes.
+  virtual bool is_at_rest(NodeInputWindow&);
+  // Non-null for nodes that can be evaluated voice by voice
+  virtual VoiceNode* as_voice_node();
+  // Override if process reads the voices of the input socket interleaved
+  // when they are (see AudioData::lanes), poly isn't filled in for it then
+  virtual bool reads_voice_lanes(size_t socket);
   Node(SocketTypeList, SocketTypeList, PropertyTypeList, bool is_sink=false);
   virtual ~Node() = 0;
   
+  // Nodes of all types are placed next to each other in a shared arena
+  static void* operator new(size_t);
+  static void operator delete(void*, size_t);
+  
   typedef Node* (*Creator)();
 };
 
+// Node whose voices are independent of each other. A block is processed
+// as begin_voices, process_voices on batches of the active voices and
+// end_voices, which lets NodeTree run a batch of voices through a whole
+// chain of such nodes while their chunks are still in cache. The audio
+// outputs are polyphonic in the output universe.
+class VoiceNode : public Node {
+  std::vector<size_t> active_voices;
+  public:
+  // Most voices handed to process_voices at once
+  static const size_t batch_size = 4;
+  using Node::Node;
+  VoiceNode* as_voice_node() override;
+  // Size the audio outputs to the output universe before begin_voices,
+  // and finish them after end_voices
+  void begin_outputs(NodeInputWindow&);
+  void end_outputs();
+  // Called once per block before any voice is processed. Output flags set
+  // here are read by the following nodes of a voice group before any voice
+  // is processed, so they have to be final, others are set in end_voices.
+  virtual void begin_voices(NodeInputWindow&);
+  // Process the given active voices, may be called concurrently for
+  // different voices so only state belonging to them may be touched.
+  // Calls process_voice for each by default.
+  virtual void process_voices(NodeInputWindow&, const size_t*, size_t);
+  virtual void process_voice(NodeInputWindow&, size_t);
+  // Called once per block after all voices have been processed
+  virtual void end_voices(NodeInputWindow&);
+  // Override if process runs the voices interleaved in groups of
+  // VOICE_LANES instead, the node is then kept out of voice groups
+  virtual bool processes_voice_lanes();
+  void process(NodeInputWindow&) override;
+};
+
 // Node registration singleton helper (or factory, if you will)
 // Usage:
 // static NodeTypeRegistration<NodeClass> registration("identifier");
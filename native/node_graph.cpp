@@ -0,0 +1,182 @@
+#include "node_graph.hpp"
+
+namespace audionodes {
+
+void NodeGraph::add_node(node_uid id, size_t input_count, size_t output_count) {
+  if (vertices.count(id)) return;
+  Vertex &vertex = vertices[id];
+  vertex.position = order.size();
+  vertex.input_count = input_count;
+  vertex.output_count = output_count;
+  order.push_back(id);
+}
+
+void NodeGraph::remove_node(node_uid id) {
+  auto found = vertices.find(id);
+  if (found == vertices.end()) return;
+  // Copies, remove_link modifies the originals
+  std::vector<Link> links = found->second.links_to;
+  links.insert(links.end(), found->second.links_from.begin(), found->second.links_from.end());
+  for (Link link : links) {
+    remove_link(link);
+  }
+  order[found->second.position] = -1;
+  holes++;
+  vertices.erase(found);
+}
+
+bool NodeGraph::has_node(node_uid id) const {
+  return vertices.count(id);
+}
+
+bool NodeGraph::has_sockets(Link link) const {
+  auto from = vertices.find(link.from_node), to = vertices.find(link.to_node);
+  if (from == vertices.end() || to == vertices.end()) return false;
+  return link.from_socket < from->second.output_count && link.to_socket < to->second.input_count;
+}
+
+const NodeGraph::Link* NodeGraph::find_link_to(node_uid id, size_t to_socket) const {
+  auto found = vertices.find(id);
+  if (found == vertices.end()) return nullptr;
+  for (const Link &link : found->second.links_to) {
+    if (link.to_socket == to_socket) return &link;
+  }
+  return nullptr;
+}
+
+bool NodeGraph::visit_forward(node_uid id, size_t upper_bound, std::vector<node_uid> &visited) {
+  Vertex &vertex = vertices.at(id);
+  vertex.visited = true;
+  visited.push_back(id);
+  for (const Link &link : vertex.links_from) {
+    Vertex &next = vertices.at(link.to_node);
+    // Reaching the upper bound means reaching the start of the new link
+    if (next.position == upper_bound) return false;
+    if (!next.visited && next.position < upper_bound) {
+      if (!visit_forward(link.to_node, upper_bound, visited)) return false;
+    }
+  }
+  return true;
+}
+
+void NodeGraph::visit_backward(node_uid id, size_t lower_bound, std::vector<node_uid> &visited) {
+  Vertex &vertex = vertices.at(id);
+  vertex.visited = true;
+  visited.push_back(id);
+  for (const Link &link : vertex.links_to) {
+    Vertex &next = vertices.at(link.from_node);
+    if (!next.visited && next.position > lower_bound) {
+      visit_backward(link.from_node, lower_bound, visited);
+    }
+  }
+}
+
+bool NodeGraph::add_link(Link link) {
+  if (!has_sockets(link)) return false;
+  if (link.from_node == link.to_node) return false;
+  if (has_link(link)) return true;
+  if (find_link_to(link.to_node, link.to_socket)) return false;
+  Vertex &from = vertices.at(link.from_node), &to = vertices.at(link.to_node);
+  if (from.position > to.position) {
+    // Only the nodes positioned between the two endpoints can be affected:
+    // those reachable from the target have to move after those the source
+    // is reachable from
+    std::vector<node_uid> forward, backward;
+    bool acyclic = visit_forward(link.to_node, from.position, forward);
+    if (acyclic) visit_backward(link.from_node, to.position, backward);
+    for (node_uid id : forward) vertices.at(id).visited = false;
+    for (node_uid id : backward) vertices.at(id).visited = false;
+    if (!acyclic) return false;
+    auto by_position = [this](node_uid a, node_uid b) {
+      return vertices.at(a).position < vertices.at(b).position;
+    };
+    std::sort(forward.begin(), forward.end(), by_position);
+    std::sort(backward.begin(), backward.end(), by_position);
+    std::vector<size_t> positions;
+    positions.reserve(forward.size()+backward.size());
+    for (node_uid id : backward) positions.push_back(vertices.at(id).position);
+    for (node_uid id : forward) positions.push_back(vertices.at(id).position);
+    std::sort(positions.begin(), positions.end());
+    size_t i = 0;
+    for (node_uid id : backward) {
+      vertices.at(id).position = positions[i];
+      order[positions[i++]] = id;
+    }
+    for (node_uid id : forward) {
+      vertices.at(id).position = positions[i];
+      order[positions[i++]] = id;
+    }
+  }
+  from.links_from.push_back(link);
+  to.links_to.push_back(link);
+  return true;
+}
+
+static bool erase_link(std::vector<NodeGraph::Link> &links, const NodeGraph::Link &link) {
+  auto found = std::find(links.begin(), links.end(), link);
+  if (found == links.end()) return false;
+  links.erase(found);
+  return true;
+}
+
+size_t NodeGraph::LinkHash::operator()(const Link &link) const {
+  size_t hash = std::hash<node_uid>()(link.from_node);
+  for (size_t part : {size_t(link.to_node), link.from_socket, link.to_socket}) {
+    hash = hash*31 + part;
+  }
+  return hash;
+}
+
+bool NodeGraph::remove_link(Link link) {
+  if (!vertices.count(link.from_node) || !vertices.count(link.to_node)) return false;
+  erase_link(vertices.at(link.from_node).links_from, link);
+  return erase_link(vertices.at(link.to_node).links_to, link);
+}
+
+bool NodeGraph::has_link(Link link) const {
+  auto found = vertices.find(link.to_node);
+  if (found == vertices.end()) return false;
+  const std::vector<Link> &links = found->second.links_to;
+  return std::find(links.begin(), links.end(), link) != links.end();
+}
+
+const std::vector<NodeGraph::Link>& NodeGraph::get_links_to(node_uid id) const {
+  return vertices.at(id).links_to;
+}
+
+const std::vector<NodeGraph::Link>& NodeGraph::get_links_from(node_uid id) const {
+  return vertices.at(id).links_from;
+}
+
+std::vector<NodeGraph::Link> NodeGraph::get_links() const {
+  std::vector<Link> links;
+  for (auto &id_vertex_pair : vertices) {
+    const std::vector<Link> &to = id_vertex_pair.second.links_to;
+    links.insert(links.end(), to.begin(), to.end());
+  }
+  return links;
+}
+
+void NodeGraph::compact() {
+  size_t kept = 0;
+  for (node_uid id : order) {
+    if (id == -1) continue;
+    vertices.at(id).position = kept;
+    order[kept++] = id;
+  }
+  order.resize(kept);
+  holes = 0;
+}
+
+const std::vector<node_uid>& NodeGraph::get_order() {
+  if (holes > 0) compact();
+  return order;
+}
+
+void NodeGraph::clear() {
+  vertices.clear();
+  order.clear();
+  holes = 0;
+}
+
+}
@@ -0,0 +1,61 @@
+
+#ifndef NODE_GRAPH_HPP
+#define NODE_GRAPH_HPP
+
+#include "common.hpp"
+#include "node_tree.hpp"
+#include <unordered_map>
+
+namespace audionodes {
+
+// Persistent link structure between all existing nodes, from which
+// NodeTrees are built. A topological order of all nodes is maintained
+// incrementally (Pearce-Kelly): adding a link only reorders the nodes
+// between its endpoints, removing one never invalidates the order.
+class NodeGraph {
+  public:
+  typedef NodeTree::ConstructionLink Link;
+  struct LinkHash {
+    size_t operator()(const Link&) const;
+  };
+  
+  private:
+  struct Vertex {
+    size_t position;
+    size_t input_count, output_count;
+    std::vector<Link> links_to, links_from;
+    bool visited = false;
+  };
+  std::unordered_map<node_uid, Vertex> vertices;
+  // Holes (removed nodes) are marked with -1 until the next compaction
+  std::vector<node_uid> order;
+  size_t holes = 0;
+  bool visit_forward(node_uid, size_t, std::vector<node_uid>&);
+  void visit_backward(node_uid, size_t, std::vector<node_uid>&);
+  void compact();
+  
+  public:
+  void add_node(node_uid, size_t input_count, size_t output_count);
+  // Also removes all links to and from the node
+  void remove_node(node_uid);
+  bool has_node(node_uid) const;
+  // Whether both nodes exist and have the sockets of the link
+  bool has_sockets(Link) const;
+  // The link into an input, nullptr if it isn't linked
+  const Link* find_link_to(node_uid, size_t to_socket) const;
+  // Returns false (and changes nothing) if the link would create a loop,
+  // has a socket the nodes don't or goes into an already linked input
+  bool add_link(Link);
+  bool remove_link(Link);
+  bool has_link(Link) const;
+  const std::vector<Link>& get_links_to(node_uid) const;
+  const std::vector<Link>& get_links_from(node_uid) const;
+  std::vector<Link> get_links() const;
+  // All nodes, each after the nodes it has links from
+  const std::vector<node_uid>& get_order();
+  void clear();
+};
+
+}
+
+#endif
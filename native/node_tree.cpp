@@ -1,4 +1,12 @@
 #include "node_tree.hpp"
+#include "data/midi.hpp"
+#include "data/trigger.hpp"
+#include "util/kernels.hpp"
+
+#include <iostream>
+#include <queue>
+#include <functional>
+#include <algorithm>
 
 namespace audionodes {
 
@@ -8,84 +16,910 @@ NodeTree::Link::Link(bool connected, size_t node, size_t socket) :
   from_socket(socket)
 {}
 
+bool NodeTree::ConstructionLink::operator==(const ConstructionLink &other) const {
+  return from_node == other.from_node && to_node == other.to_node
+    && from_socket == other.from_socket && to_socket == other.to_socket;
+}
+
+AudioData* NodeTree::BufferPool::get(size_t index) {
+  while (buffers.size() <= index) {
+    buffers.emplace_back(new AudioData());
+  }
+  return buffers[index].get();
+}
+
+bool NodeTree::is_linked(size_t i, size_t j) const {
+  const Link &link = links[i][j];
+  if (!link.connected) return false;
+  Node *from = node_evaluation_order[link.from_node], *to = node_evaluation_order[i];
+  return from->output_socket_types[link.from_socket] == to->input_socket_types[j];
+}
+
+bool NodeTree::has_same_links(size_t i, const NodeTree &previous, size_t previous_i) const {
+  const std::vector<Link> &current_links = links[i], &previous_links = previous.links[previous_i];
+  if (current_links.size() != previous_links.size()) return false;
+  for (size_t j = 0; j < current_links.size(); ++j) {
+    const Link &current = current_links[j], &old = previous_links[j];
+    if (current.connected != old.connected) return false;
+    if (current.connected && (current.from_socket != old.from_socket
+        || node_evaluation_order[current.from_node] != previous.node_evaluation_order[old.from_node])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void NodeTree::assign_buffers(
+    const std::vector<std::vector<uint64_t>> &ancestors,
+    const NodeTree *previous, const PreviousIndex &previous_index) {
+  // Outputs numbered consecutively, node by node
+  std::vector<size_t> first_output(amount+1, 0);
+  for (size_t i = 0; i < amount; ++i) {
+    first_output[i+1] = first_output[i]+node_evaluation_order[i]->output_socket_types.size();
+  }
+  const size_t output_amount = first_output[amount];
+  // Nodes reading each output, in order
+  std::vector<size_t> first_reader(output_amount+1, 0), readers;
+  for (size_t i = 0; i < amount; ++i) {
+    for (size_t j = 0; j < links[i].size(); ++j) {
+      const Link &link = links[i][j];
+      if (is_linked(i, j)) {
+        first_reader[first_output[link.from_node]+link.from_socket+1]++;
+      } else if (link.connected) {
+        std::cerr << "Audionodes native: Link between sockets of different types, treating as unconnected" << std::endl;
+      }
+    }
+  }
+  for (size_t output = 0; output < output_amount; ++output) {
+    first_reader[output+1] += first_reader[output];
+  }
+  readers.resize(first_reader[output_amount]);
+  std::vector<size_t> next_reader(first_reader.begin(), first_reader.end()-1);
+  for (size_t i = 0; i < amount; ++i) {
+    for (size_t j = 0; j < links[i].size(); ++j) {
+      if (is_linked(i, j)) readers[next_reader[first_output[links[i][j].from_node]+links[i][j].from_socket]++] = i;
+    }
+  }
+  auto is_ancestor = [&ancestors](size_t node, size_t of) {
+    return (ancestors[of][node/64] >> (node%64)) & 1;
+  };
+  
+  // Buffers of the outputs in the previous tree, those wanted again are
+  // left alone when a fresh buffer is needed
+  const size_t none = -1;
+  std::vector<size_t> preferred(output_amount, none);
+  std::vector<bool> allocated, wanted;
+  if (previous) {
+    std::unordered_map<const Data*, size_t> buffer_index;
+    for (size_t b = 0; b < buffer_pool->buffers.size(); ++b) {
+      buffer_index[buffer_pool->buffers[b].get()] = b;
+    }
+    wanted.resize(buffer_pool->buffers.size(), false);
+    for (size_t i = 0; i < amount; ++i) {
+      auto found = previous_index.find(node_evaluation_order[i]);
+      if (found == previous_index.end()) continue;
+      const std::vector<Data*> &outputs = previous->node_outputs[found->second];
+      for (size_t socket = 0; socket < outputs.size(); ++socket) {
+        auto buffer = buffer_index.find(outputs[socket]);
+        if (buffer == buffer_index.end()) continue;
+        preferred[first_output[i]+socket] = buffer->second;
+        wanted[buffer->second] = true;
+      }
+    }
+  }
+  auto is_free = [&](size_t buffer) {
+    return buffer >= allocated.size() || !allocated[buffer];
+  };
+  size_t next_fresh = 0;
+  
+  // A buffer is used by the node writing the output and its readers
+  struct Released {
+    size_t buffer, output, writer;
+  };
+  std::vector<Released> released;
+  // Released after the processing of the given node
+  std::vector<std::pair<size_t, Released>> pending;
+  node_outputs.resize(amount);
+  for (size_t i = 0; i < amount; ++i) {
+    Node *node = node_evaluation_order[i];
+    for (size_t socket = 0; socket < node->output_socket_types.size(); ++socket) {
+      if (node->output_socket_types[socket] != Node::SocketType::audio) {
+        node_outputs[i].push_back(node->output_window.ref(socket));
+        continue;
+      }
+      auto fits = [&](const Released &candidate) {
+        // Members of a voice group run interleaved, ancestors included,
+        // and pipeline stages run at the same time
+        auto may_reuse = [&](size_t user) {
+          return is_ancestor(user, i) && step_of[user] != step_of[i]
+            && node_stage[user] == node_stage[i];
+        };
+        return may_reuse(candidate.writer) && std::all_of(
+          readers.begin()+first_reader[candidate.output],
+          readers.begin()+first_reader[candidate.output+1], may_reuse);
+      };
+      const size_t output = first_output[i]+socket;
+      size_t buffer = preferred[output];
+      auto found = std::find_if(released.begin(), released.end(), [&](const Released &candidate) {
+        return candidate.buffer == buffer && fits(candidate);
+      });
+      if (found == released.end() && !(buffer != none && is_free(buffer))) {
+        found = std::find_if(released.begin(), released.end(), fits);
+        if (found == released.end()) {
+          while (!is_free(next_fresh) || (next_fresh < wanted.size() && wanted[next_fresh])) next_fresh++;
+          buffer = next_fresh;
+        }
+      }
+      if (found != released.end()) {
+        buffer = found->buffer;
+        released.erase(found);
+      }
+      if (allocated.size() <= buffer) allocated.resize(buffer+1, false);
+      allocated[buffer] = true;
+      node_outputs[i].push_back(buffer_pool->get(buffer));
+      
+      if (first_reader[output] == first_reader[output+1]) {
+        pending.push_back({i, {buffer, output, i}});
+      } else if (std::none_of(readers.begin()+first_reader[output], readers.begin()+first_reader[output+1],
+          [this](size_t reader) { return node_evaluation_order[reader]->get_is_sink(); })) {
+        // Sink inputs are read after all nodes have been processed
+        pending.push_back({readers[first_reader[output+1]-1], {buffer, output, i}});
+      }
+    }
+    // Only now, the outputs mustn't alias the inputs of the same node
+    auto kept = pending.begin();
+    for (auto entry = pending.begin(); entry != pending.end(); ++entry) {
+      if (entry->first == i) {
+        released.push_back(entry->second);
+      } else {
+        *kept++ = *entry;
+      }
+    }
+    pending.erase(kept, pending.end());
+  }
+}
+
+void NodeTree::form_steps(
+    const std::vector<std::vector<uint64_t>> &ancestors,
+    const NodeTree *previous, const PreviousIndex &previous_index) {
+  // Universes as they will be inferred for the windows, of which only the
+  // identities matter here. Nodes with an unchanged upstream subgraph
+  // have them in their previous window already, unless mirrored there.
+  std::vector<Universe::Descriptor> universes;
+  universes.reserve(amount);
+  std::vector<bool> unchanged(amount, false);
+  bool take_over = previous && previous->stage_amount == 1;
+  for (size_t i = 0; i < amount; ++i) {
+    auto found = take_over ? previous_index.find(node_evaluation_order[i]) : previous_index.end();
+    if (found != previous_index.end() && has_same_links(i, *previous, found->second)
+        && std::all_of(links[i].begin(), links[i].end(), [&unchanged](const Link &link) {
+          return !link.connected || unchanged[link.from_node];
+        })) {
+      universes.push_back(previous->node_inputs[found->second]->universes);
+      unchanged[i] = true;
+      continue;
+    }
+    std::vector<Universe::Pointer> input_universes;
+    for (Link link : links[i]) {
+      if (link.connected) {
+        input_universes.push_back(universes[link.from_node].output);
+      } else {
+        input_universes.emplace_back(new Universe());
+      }
+    }
+    universes.push_back(node_evaluation_order[i]->infer_polyphony_operation(input_universes));
+  }
+  
+  const size_t none = -1;
+  std::vector<size_t> group(amount, none);
+  std::vector<std::vector<size_t>> groups;
+  std::vector<std::vector<uint64_t>> members;
+  for (size_t i = 0; i < amount; ++i) {
+    const Universe::Descriptor &uni = universes[i];
+    VoiceNode *voice_node = node_evaluation_order[i]->as_voice_node();
+    if (!voice_node || voice_node->processes_voice_lanes() || !uni.output->is_variable()
+        || uni.input != uni.output || uni.bundles != uni.output) continue;
+    size_t joined = none;
+    for (size_t j = 0; j < links[i].size() && joined == none; ++j) {
+      if (!is_linked(i, j)) continue;
+      size_t candidate = group[links[i][j].from_node];
+      if (candidate == none || universes[links[i][j].from_node].output != uni.output) continue;
+      // No path may leave the group and come back to this node
+      bool convex = true;
+      for (Link link : links[i]) {
+        if (!link.connected || group[link.from_node] == candidate) continue;
+        for (size_t k = 0; k < members[candidate].size(); ++k) {
+          if (ancestors[link.from_node][k] & members[candidate][k]) convex = false;
+        }
+      }
+      if (convex) joined = candidate;
+    }
+    if (joined == none) {
+      joined = groups.size();
+      groups.emplace_back();
+      members.emplace_back((amount+63)/64, 0);
+    }
+    group[i] = joined;
+    groups[joined].push_back(i);
+    members[joined][i/64] |= uint64_t(1) << (i%64);
+  }
+  
+  // A lone voice node gains nothing from voice-major evaluation
+  std::vector<size_t> group_step(groups.size(), none);
+  step_of.resize(amount);
+  for (size_t i = 0; i < amount; ++i) {
+    if (group[i] != none && groups[group[i]].size() > 1) {
+      if (group_step[group[i]] == none) {
+        group_step[group[i]] = steps.size();
+        steps.emplace_back();
+        steps.back().nodes = groups[group[i]];
+        steps.back().voice_major = true;
+      }
+      step_of[i] = group_step[group[i]];
+    } else {
+      step_of[i] = steps.size();
+      steps.emplace_back();
+      steps.back().nodes.push_back(i);
+    }
+  }
+}
+
+void NodeTree::order_steps() {
+  // Dependencies between the steps as formed
+  size_t step_amount = steps.size();
+  std::vector<std::vector<size_t>> step_dependents(step_amount);
+  std::vector<size_t> remaining(step_amount, 0);
+  for (size_t i = 0; i < amount; ++i) {
+    for (Link link : links[i]) {
+      if (!link.connected) continue;
+      size_t from = step_of[link.from_node], to = step_of[i];
+      std::vector<size_t> &from_dependents = step_dependents[from];
+      if (from == to || std::find(from_dependents.begin(), from_dependents.end(), to) != from_dependents.end()) continue;
+      from_dependents.push_back(to);
+      remaining[to]++;
+    }
+  }
+  // Topological order, groups may have to move past the nodes between
+  // their members. Otherwise the order of the nodes is kept.
+  std::vector<size_t> order, position(step_amount);
+  std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t>> ready;
+  for (size_t i = 0; i < step_amount; ++i) {
+    if (remaining[i] == 0) ready.push(i);
+  }
+  while (!ready.empty()) {
+    size_t step = ready.top();
+    ready.pop();
+    position[step] = order.size();
+    order.push_back(step);
+    for (size_t dependent : step_dependents[step]) {
+      if (--remaining[dependent] == 0) ready.push(dependent);
+    }
+  }
+  
+  std::vector<Step> ordered(step_amount);
+  dependents.assign(step_amount, {});
+  dependency_count.assign(step_amount, 0);
+  for (size_t i = 0; i < step_amount; ++i) {
+    ordered[position[i]] = std::move(steps[i]);
+    for (size_t dependent : step_dependents[i]) {
+      dependents[position[i]].push_back(position[dependent]);
+      dependency_count[position[dependent]]++;
+    }
+  }
+  steps = std::move(ordered);
+  for (size_t i = 0; i < step_amount; ++i) {
+    for (size_t node : steps[i].nodes) step_of[node] = i;
+    if (steps[i].voice_major) {
+      steps[i].elapsed.reset(new std::atomic<uint64_t>[steps[i].nodes.size()]);
+    }
+  }
+  
+  std::vector<size_t> level(step_amount, 0), level_width(step_amount+1, 0);
+  for (size_t i = 0; i < step_amount; ++i) {
+    for (size_t dependent : dependents[i]) {
+      level[dependent] = std::max(level[dependent], level[i]+1);
+    }
+    max_level_width = std::max(max_level_width, ++level_width[level[i]]);
+  }
+  remaining_dependencies.reset(new std::atomic<size_t>[step_amount]);
+}
+
+void NodeTree::assign_stages(size_t stages, const NodeTree *previous) {
+  stages = std::max<size_t>(1, std::min(stages, steps.size()));
+  std::vector<double> cost(steps.size(), 0);
+  double total = 0;
+  for (size_t i = 0; i < steps.size(); ++i) {
+    for (size_t node : steps[i].nodes) {
+      // Nodes without timings yet count as cheap
+      TimingStats::Summary summary = node_evaluation_order[node]->timing.get_summary();
+      cost[i] += summary.count > 0 ? std::max(summary.mean, 1.) : 1.;
+    }
+    total += cost[i];
+  }
+  stage_begin.assign(1, 0);
+  double accumulated = 0;
+  for (size_t i = 0; i < steps.size(); ++i) {
+    size_t started = stage_begin.size();
+    // Cut once the share of the stage is done, or if the remaining steps
+    // are needed for one stage each
+    if (started < stages && i > stage_begin.back()
+        && (accumulated >= total*started/stages || steps.size()-i <= stages-started)) {
+      stage_begin.push_back(i);
+    }
+    accumulated += cost[i];
+  }
+  stage_begin.push_back(steps.size());
+  stage_amount = std::max<size_t>(1, stage_begin.size()-1);
+  
+  // A node moving to another stage restarts the blocks flowing through it,
+  // so the stages of the previous tree are kept (new nodes joining the
+  // stage before them) unless a balanced split halves the slowest stage
+  if (previous && previous->stage_amount == stage_amount && stage_amount > 1) {
+    std::unordered_map<Node*, size_t> previous_stage;
+    for (size_t i = 0; i < previous->amount; ++i) {
+      previous_stage[previous->node_evaluation_order[i]] = previous->node_stage[i];
+    }
+    std::vector<size_t> kept_begin(1, 0);
+    size_t stage = 0;
+    for (size_t i = 0; i < steps.size(); ++i) {
+      for (size_t node : steps[i].nodes) {
+        auto found = previous_stage.find(node_evaluation_order[node]);
+        if (found != previous_stage.end()) stage = std::max(stage, found->second);
+      }
+      while (kept_begin.size() <= stage) kept_begin.push_back(i);
+    }
+    kept_begin.push_back(steps.size());
+    auto slowest = [&cost](const std::vector<size_t> &begin) {
+      double slowest = 0;
+      for (size_t k = 0; k+1 < begin.size(); ++k) {
+        double stage_cost = 0;
+        for (size_t i = begin[k]; i < begin[k+1]; ++i) stage_cost += cost[i];
+        slowest = std::max(slowest, stage_cost);
+      }
+      return slowest;
+    };
+    bool feasible = kept_begin.size() == stage_begin.size()
+      && std::adjacent_find(kept_begin.begin(), kept_begin.end(), std::greater_equal<size_t>()) == kept_begin.end();
+    if (feasible && slowest(kept_begin) <= 2*slowest(stage_begin)) stage_begin = kept_begin;
+  }
+  
+  node_stage.assign(amount, 0);
+  for (size_t stage = 0; stage+1 < stage_begin.size(); ++stage) {
+    for (size_t i = stage_begin[stage]; i < stage_begin[stage+1]; ++i) {
+      for (size_t node : steps[i].nodes) node_stage[node] = stage;
+    }
+  }
+  stage_ready.assign(stage_amount, true);
+  // The delayed output of the previous tree still has to come out
+  if (previous && previous->stage_amount == stage_amount) {
+    pipeline = previous->pipeline;
+    return;
+  }
+  pipeline = std::make_shared<Pipeline>();
+  pipeline->sink_delays.resize(stage_amount-1);
+  for (size_t stage = 0; stage+1 < stage_amount; ++stage) {
+    DelayLine &line = pipeline->sink_delays[stage];
+    line.chunks.assign(stage_amount-1-stage, Chunk());
+    for (Chunk &chunk : line.chunks) chunk.fill(0);
+  }
+}
+
+Universe::Pointer NodeTree::mirror(const Universe::Pointer &universe, size_t stage, const NodeTree *previous) {
+  // Only variable universes change from block to block
+  if (!universe->is_variable()) return universe;
+  auto home = universe_stage.find(universe.get());
+  if (home == universe_stage.end() || home->second == stage) return universe;
+  for (const auto &existing : mirrors) {
+    if (existing->source == universe.get() && existing->stage == stage) return existing->mirror;
+  }
+  size_t depth = stage-home->second;
+  // A universe taken over from the previous tree keeps its history
+  if (previous) {
+    for (const auto &carried : previous->mirrors) {
+      if (carried->source == universe.get() && carried->stage == stage && carried->history.size() == depth) {
+        mirrors.push_back(carried);
+        universe_stage[carried->mirror.get()] = stage;
+        return carried->mirror;
+      }
+    }
+  }
+  // The source may belong to a window taken over from the tree being
+  // evaluated right now, so only its identity is copied here. The slots
+  // follow in advance_latches, before the stage first runs.
+  Universe::Pointer copy = std::make_shared<Universe>(universe->blank_copy());
+  mirrors.emplace_back(new Mirror{universe.get(), stage, copy, std::vector<Universe>(depth, copy->blank_copy())});
+  universe_stage[copy.get()] = stage;
+  return copy;
+}
+
+size_t NodeTree::latch(size_t from, size_t socket, size_t stage, const NodeTree *previous) {
+  const Data *source = node_outputs[from][socket];
+  for (size_t i = 0; i < latches.size(); ++i) {
+    if (latches[i].source == source && latches[i].stage == stage) return i;
+  }
+  Latch latch;
+  latch.source = source;
+  latch.node = node_evaluation_order[from];
+  latch.socket = socket;
+  latch.source_stage = node_stage[from];
+  latch.stage = stage;
+  latch.voices = mirror(node_inputs[from]->universes.output, stage, previous).get();
+  // The blocks in flight from the same output carry over, as long as
+  // their voices are still described by the same universe
+  if (previous) {
+    for (const Latch &carried : previous->latches) {
+      if (carried.node == latch.node && carried.socket == socket
+          && carried.source_stage == latch.source_stage && carried.stage == stage
+          && (carried.voices == latch.voices
+            || (!latch.voices->is_variable() && *carried.voices == *latch.voices))) {
+        latch.state = carried.state;
+        latches.push_back(std::move(latch));
+        return latches.size()-1;
+      }
+    }
+  }
+  latch.state = std::make_shared<LatchSlots>();
+  for (size_t i = node_stage[from]; i < stage; ++i) {
+    Data *slot;
+    switch (source->type) {
+      case Data::Type::audio:
+        slot = new AudioData(true, 0);
+        break;
+      case Data::Type::midi:
+        slot = new MidiData();
+        break;
+      case Data::Type::trigger:
+        slot = new TriggerData();
+        break;
+      default:
+        slot = new Data();
+    }
+    latch.state->slots.emplace_back(slot);
+  }
+  latches.push_back(std::move(latch));
+  return latches.size()-1;
+}
+
+// Copy of the block held by from, for the latches
+static void copy_block(Data &to, const Data &from, const Universe *voices) {
+  switch (from.type) {
+    case Data::Type::audio:
+      static_cast<AudioData&>(to).copy_block(static_cast<const AudioData&>(from), voices);
+      break;
+    case Data::Type::midi:
+      static_cast<MidiData&>(to).events = static_cast<const MidiData&>(from).events;
+      break;
+    case Data::Type::trigger:
+      static_cast<TriggerData&>(to).events = static_cast<const TriggerData&>(from).events;
+      break;
+    default:
+      break;
+  }
+}
+
+std::vector<size_t> NodeTree::get_stage_waits() const {
+  std::vector<size_t> waits(stage_amount);
+  for (size_t stage = 0; stage < stage_amount; ++stage) {
+    waits[stage] = stage > pipeline->filled ? stage-pipeline->filled : 0;
+  }
+  // A latch is written once per block of its source stage
+  for (const Latch &entry : latches) {
+    const LatchSlots &state = *entry.state;
+    size_t wait = waits[entry.source_stage] + state.slots.size()-state.written;
+    waits[entry.stage] = std::max(waits[entry.stage], wait);
+  }
+  return waits;
+}
+
+void NodeTree::advance_latches() {
+  // Later stages first, a mirror may be the source of another one
+  for (auto &entry : mirrors) {
+    if (!stage_ready[entry->stage-entry->history.size()]) continue;
+    entry->history[entry->next].copy_slots(*entry->source);
+    entry->next = (entry->next+1) % entry->history.size();
+    entry->mirror->copy_slots(entry->history[entry->next]);
+  }
+  for (Latch &entry : latches) {
+    if (!stage_ready[entry.source_stage]) continue;
+    LatchSlots &state = *entry.state;
+    copy_block(*state.slots[state.next], *entry.source, entry.voices);
+    state.next = (state.next+1) % state.slots.size();
+    state.written = std::min(state.written+1, state.slots.size());
+  }
+}
+
+void NodeTree::point_latch_readers() {
+  for (Latch &entry : latches) {
+    Data *oldest = entry.state->slots[entry.state->next].get();
+    // Blocks carried over from the previous tree name its universe
+    if (Data::holds<AudioData>(oldest)) {
+      AudioData &audio = *static_cast<AudioData*>(oldest);
+      if (audio.voices) audio.voices = entry.voices;
+    }
+    for (auto &reader : entry.readers) {
+      NodeInputWindow::Socket &socket = (*reader.first)[reader.second];
+      socket.data = oldest;
+      socket.audio = &Data::extract<AudioData>(oldest);
+    }
+  }
+}
+
+NodeTree::WindowReuse NodeTree::get_window_reuse(
+    size_t i, const NodeTree &previous, size_t previous_i,
+    const std::vector<bool> &reused) const {
+  if (!has_same_links(i, previous, previous_i)) return WindowReuse::none;
+  bool same_data = true;
+  for (size_t j = 0; j < links[i].size(); ++j) {
+    const Link &current = links[i][j], &old = previous.links[previous_i][j];
+    if (!current.connected) continue;
+    // Links between pipeline stages read latches of their own tree
+    if (node_stage[current.from_node] != node_stage[i]
+        || previous.node_stage[old.from_node] != previous.node_stage[previous_i]) {
+      return WindowReuse::none;
+    }
+    // The source has to have unchanged universes itself
+    if (!reused[current.from_node]) return WindowReuse::none;
+    if (node_outputs[current.from_node][current.from_socket]
+        != previous.node_outputs[old.from_node][old.from_socket]) {
+      same_data = false;
+    }
+  }
+  return same_data ? WindowReuse::all : WindowReuse::universes;
+}
 
-NodeTree::NodeTree(std::vector<Node*> order, std::vector<std::vector<Link>> links) :
+NodeTree::NodeTree(std::vector<Node*> order, std::vector<std::vector<Link>> node_links, const NodeTree *previous, size_t stages) :
   amount(order.size()),
-  node_evaluation_order(order)
+  node_evaluation_order(std::move(order)),
+  links(std::move(node_links)),
+  buffer_pool(previous ? previous->buffer_pool : std::make_shared<BufferPool>()),
+  completed(0)
 {
+  std::vector<std::vector<uint64_t>> ancestors(amount, std::vector<uint64_t>((amount+63)/64, 0));
+  for (size_t i = 0; i < amount; ++i) {
+    if (node_evaluation_order[i]->get_is_sink()) sinks.push_back(i);
+    
+    for (Link link : links[i]) {
+      if (!link.connected) continue;
+      for (size_t k = 0; k < ancestors[i].size(); ++k) {
+        ancestors[i][k] |= ancestors[link.from_node][k];
+      }
+      ancestors[i][link.from_node/64] |= uint64_t(1) << (link.from_node%64);
+    }
+  }
+  PreviousIndex previous_index;
+  if (previous) {
+    for (size_t i = 0; i < previous->amount; ++i) {
+      previous_index[previous->node_evaluation_order[i]] = i;
+    }
+  }
+  form_steps(ancestors, previous, previous_index);
+  order_steps();
+  assign_stages(stages, previous);
+  assign_buffers(ancestors, previous, previous_index);
+  
   node_inputs.reserve(amount);
+  // Only mirroring needs the stages of the universes
+  auto record_stage = [this](const Universe::Descriptor &universes, size_t stage) {
+    if (stage_amount == 1) return;
+    for (const Universe *universe : {universes.input.get(), universes.bundles.get(), universes.output.get()}) {
+      universe_stage.emplace(universe, stage);
+    }
+  };
+  // Whether the universes of the window are taken over
+  std::vector<bool> reused(amount, false);
   for (size_t i = 0; i < amount; ++i) {
     Node *node = node_evaluation_order[i];
+    auto found = previous_index.find(node);
+    WindowReuse reuse = found != previous_index.end()
+      ? get_window_reuse(i, *previous, found->second, reused) : WindowReuse::none;
+    if (reuse != WindowReuse::none) {
+      const std::shared_ptr<NodeInputWindow> &window = previous->node_inputs[found->second];
+      if (reuse == WindowReuse::all) {
+        node_inputs.push_back(window);
+      } else {
+        // A copy reading the buffers of this tree, the inline values are
+        // shared as only the evaluated tree writes them
+        node_inputs.emplace_back(new NodeInputWindow(*window));
+        for (size_t j = 0; j < links[i].size(); ++j) {
+          if (!is_linked(i, j)) continue;
+          NodeInputWindow::Socket &socket = (*node_inputs.back())[j];
+          socket.data = node_outputs[links[i][j].from_node][links[i][j].from_socket];
+          socket.audio = &Data::extract<AudioData>(socket.data);
+        }
+      }
+      reused[i] = true;
+      record_stage(node_inputs.back()->universes, node_stage[i]);
+      continue;
+    }
     
     std::vector<Universe::Pointer> input_universes;
     input_universes.reserve(node->get_input_count());
     for (Link link : links[i]) {
       if (link.connected) {
-        input_universes.push_back(node_inputs[link.from_node].universes.output);
+        input_universes.push_back(mirror(node_inputs[link.from_node]->universes.output, node_stage[i], previous));
       } else {
         input_universes.emplace_back(new Universe());
       }
     }
     Universe::Descriptor universes = node->infer_polyphony_operation(input_universes);
     
+    record_stage(universes, node_stage[i]);
+    
     NodeInputWindow::SocketsList input_sockets;
     input_sockets.reserve(node->get_input_count());
+    std::vector<std::pair<size_t, size_t>> latched;
     for (size_t j = 0; j < node->get_input_count(); ++j) {
       Link link = links[i][j];
-      if (link.connected) {
-        Data **data = node_evaluation_order[link.from_node]->output_window.ref(link.from_socket);
+      if (is_linked(i, j)) {
+        Data *data = node_outputs[link.from_node][link.from_socket];
+        if (node_stage[link.from_node] != node_stage[i]) {
+          size_t index = latch(link.from_node, link.from_socket, node_stage[i], previous);
+          latched.push_back({index, j});
+          // Pointed to the oldest block when evaluating, the carried
+          // slots may be in use right now
+          data = latches[index].state->slots[0].get();
+        }
         // The data will be viewed as collapsed if the chosen universes aren't compatible
-        bool view_collapsed = *universes.input != *node_inputs[link.from_node].universes.output;
+        bool view_collapsed = *universes.input != *node_inputs[link.from_node]->universes.output;
         input_sockets.emplace_back(data, view_collapsed, false);
       } else {
-        Data **tmp_data_ptr = nullptr;
+        Data *tmp_data = nullptr;
         bool tmp_audio_data = false;
         if (node->input_socket_types[j] == Node::SocketType::audio) {
           // Unconnected audio socket input -> inline value control
-          Data *data = new AudioData(true, 0);
-          tmp_data_ptr = new Data*(data);
+          tmp_data = new AudioData(true, 0);
           tmp_audio_data = true;
         }
-        input_sockets.emplace_back(tmp_data_ptr, true, tmp_audio_data);
+        input_sockets.emplace_back(tmp_data, true, tmp_audio_data);
       }
     }
     
-    node_inputs.emplace_back(input_sockets, universes);
+    node_inputs.emplace_back(new NodeInputWindow(input_sockets, universes));
+    for (auto &entry : latched) {
+      latches[entry.first].readers.push_back({node_inputs.back().get(), entry.second});
+    }
   }
+  std::stable_sort(mirrors.begin(), mirrors.end(), [](const std::shared_ptr<Mirror> &a, const std::shared_ptr<Mirror> &b) {
+    return a->stage > b->stage;
+  });
+  std::stable_sort(latches.begin(), latches.end(), [](const Latch &a, const Latch &b) {
+    return a.stage < b.stage;
+  });
 }
 
-const Chunk& NodeTree::evaluate() {
-  output.fill(0.);
-  for (size_t i = 0; i < amount; ++i) {
-    Node *node = node_evaluation_order[i];
-    // Collect node inputs
-    size_t input_amt = node->get_input_count();
-    for (size_t j = 0; j < input_amt; ++j) {
-      if (node_inputs[i][j].tmp_audio_data) {
-        // Interpolate earlier value and new value
-        float old_v = node->old_input_values[j];
-        float new_v = node->get_input_value(j);
-        Chunk &audio = node_inputs[i][j].get_write<AudioData>().mono;
-        if (old_v == new_v) audio.fill(new_v);
-        else {
-          for (size_t k = 0; k < N; ++k) {
-            audio[k] = ((N-k-1)*old_v + (k+1)*new_v)/N;
-          }
-          node->old_input_values[j] = new_v;
-        }
+bool NodeTree::prepare_node(size_t i) {
+  Node *node = node_evaluation_order[i];
+  NodeInputWindow &input = *node_inputs[i];
+  // Collect node inputs
+  size_t input_amt = node->get_input_count();
+  for (size_t j = 0; j < input_amt; ++j) {
+    if (input[j].tmp_audio_data) {
+      // Interpolate earlier value and new value
+      float old_v = node->old_input_values[j];
+      float new_v = node->get_input_value(j);
+      AudioData &data = *input[j].audio;
+      Chunk &audio = data.mono;
+      if (old_v == new_v) {
+        kernels::fill(audio, new_v);
+        data.set_constant(new_v == 0);
+      } else {
+        data.clear_flags();
+        kernels::ramp(audio, old_v, new_v, 1);
+        node->old_input_values[j] = new_v;
       }
     }
-    // Process node
-    node->apply_bundle_universe_changes(*node_inputs[i].universes.bundles);
-    node->process(node_inputs[i]);
-    if (node->get_is_sink()) {
-      const AudioData &data = node_inputs[i][0].get<AudioData>();
-      for (size_t j = 0; j < N; ++j) {
-        output[j] += data.mono[j];
-      }
+  }
+  // Collapsed versions are computed on demand, before the voices are
+  // possibly processed in parallel
+  size_t channels = input.get_channel_amount();
+  for (size_t j = 0; j < input_amt; ++j) {
+    input[j].prepare(channels, node->reads_voice_lanes(j));
+  }
+  input.pool = pool;
+  node->output_window.bind(node_outputs[i].data());
+  node->apply_bundle_universe_changes(*input.universes.bundles);
+  if (node->is_at_rest(input)) {
+    for (Data *data : node_outputs[i]) {
+      if (!Data::holds<AudioData>(data)) continue;
+      AudioData &audio = *static_cast<AudioData*>(data);
+      kernels::fill(audio.write_mono(), 0);
+      audio.set_constant(true);
     }
+    return false;
+  }
+  for (Data *data : node_outputs[i]) {
+    if (Data::holds<AudioData>(data)) static_cast<AudioData*>(data)->clear_flags();
+  }
+  return true;
+}
+
+void NodeTree::process_node(size_t i) {
+  Node *node = node_evaluation_order[i];
+  NodeInputWindow &input = *node_inputs[i];
+  auto start = std::chrono::steady_clock::now();
+  if (prepare_node(i)) node->process(input);
+  auto elapsed = std::chrono::steady_clock::now()-start;
+  node->timing.record(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+    input.get_channel_amount());
+}
+
+void NodeTree::process_voice_group(Step &step) {
+  typedef std::chrono::steady_clock Clock;
+  auto nanoseconds_since = [](Clock::time_point start) -> uint64_t {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now()-start).count();
+  };
+  const size_t member_amount = step.nodes.size();
+  step.running.assign(member_amount, false);
+  // In order, so the outputs read by a member have been sized already
+  for (size_t k = 0; k < member_amount; ++k) {
+    size_t i = step.nodes[k];
+    auto start = Clock::now();
+    step.running[k] = prepare_node(i);
+    if (step.running[k]) {
+      VoiceNode &node = *node_evaluation_order[i]->as_voice_node();
+      node.begin_outputs(*node_inputs[i]);
+      node.begin_voices(*node_inputs[i]);
+    }
+    step.elapsed[k] = nanoseconds_since(start);
+  }
+  // All members share the universe
+  NodeInputWindow &first = *node_inputs[step.nodes[0]];
+  size_t n = first.get_channel_amount();
+  step.voices.clear();
+  for (size_t i = 0; i < n; ++i) {
+    if (first.is_active(i)) step.voices.push_back(i);
+  }
+  const size_t batch_size = VoiceNode::batch_size;
+  auto process_batch = [&](size_t batch) {
+    size_t begin = batch*batch_size;
+    size_t count = std::min(batch_size, step.voices.size()-begin);
+    for (size_t k = 0; k < member_amount; ++k) {
+      if (!step.running[k]) continue;
+      size_t i = step.nodes[k];
+      auto start = Clock::now();
+      node_evaluation_order[i]->as_voice_node()->process_voices(
+        *node_inputs[i], &step.voices[begin], count);
+      step.elapsed[k] += nanoseconds_since(start);
+    }
+  };
+  size_t batches = (step.voices.size()+batch_size-1)/batch_size;
+  if (pool && pool->should_split_voices(step.voices.size())) {
+    pool->parallel_for(batches, process_batch);
+  } else {
+    for (size_t batch = 0; batch < batches; ++batch) {
+      process_batch(batch);
+    }
+  }
+  for (size_t k = 0; k < member_amount; ++k) {
+    size_t i = step.nodes[k];
+    Node *node = node_evaluation_order[i];
+    if (step.running[k]) {
+      auto start = Clock::now();
+      node->as_voice_node()->end_voices(*node_inputs[i]);
+      node->as_voice_node()->end_outputs();
+      step.elapsed[k] += nanoseconds_since(start);
+    }
+    node->timing.record(step.elapsed[k], n);
+  }
+}
+
+void NodeTree::process_step(size_t i) {
+  Step &step = steps[i];
+  if (step.voice_major) {
+    process_voice_group(step);
+  } else {
+    process_node(step.nodes[0]);
+  }
+}
+
+void NodeTree::process_step_task(void *tree_ptr, size_t i) {
+  NodeTree &tree = *static_cast<NodeTree*>(tree_ptr);
+  tree.process_step(i);
+  // Queue the dependents that became ready
+  for (size_t dependent : tree.dependents[i]) {
+    if (--tree.remaining_dependencies[dependent] == 0) {
+      tree.pool->push({process_step_task, tree_ptr, dependent});
+    }
+  }
+  tree.completed++;
+}
+
+void NodeTree::process_stage_task(void *tree_ptr, size_t stage) {
+  NodeTree &tree = *static_cast<NodeTree*>(tree_ptr);
+  if (tree.stage_ready[stage]) {
+    for (size_t i = tree.stage_begin[stage]; i < tree.stage_begin[stage+1]; ++i) {
+      tree.process_step(i);
+    }
+  }
+  tree.completed++;
+}
+
+void NodeTree::evaluate_pipelined() {
+  completed = 0;
+  if (pool && pool->get_thread_amount() > 0) {
+    for (size_t stage = 0; stage < stage_amount; ++stage) {
+      pool->push({process_stage_task, this, stage});
+    }
+    pool->run_until([this]() { return completed == stage_amount; });
+  } else {
+    for (size_t stage = 0; stage < stage_amount; ++stage) {
+      process_stage_task(this, stage);
+    }
+  }
+}
+
+void NodeTree::evaluate_parallel() {
+  completed = 0;
+  for (size_t i = 0; i < steps.size(); ++i) {
+    remaining_dependencies[i] = dependency_count[i];
+  }
+  for (size_t i = 0; i < steps.size(); ++i) {
+    if (dependency_count[i] == 0) pool->push({process_step_task, this, i});
+  }
+  pool->run_until([this]() { return completed == steps.size(); });
+}
+
+const Chunk& NodeTree::evaluate(WorkerPool *pool) {
+  this->pool = pool;
+  if (stage_amount > 1) {
+    std::vector<size_t> waits = get_stage_waits();
+    for (size_t stage = 0; stage < stage_amount; ++stage) {
+      stage_ready[stage] = waits[stage] == 0;
+    }
+    point_latch_readers();
+    evaluate_pipelined();
+  } else if (pool && pool->get_thread_amount() > 0 && max_level_width > 1) {
+    evaluate_parallel();
+  } else {
+    for (size_t i = 0; i < steps.size(); ++i) {
+      process_step(i);
+    }
+  }
+  kernels::fill(output, 0);
+  std::vector<DelayLine> &sink_delays = pipeline->sink_delays;
+  for (DelayLine &line : sink_delays) {
+    Chunk &delayed = line.chunks[line.next];
+    kernels::add(output, delayed);
+    kernels::fill(delayed, 0);
+  }
+  for (size_t i : sinks) {
+    // A waiting stage has nothing to output yet
+    size_t stage = node_stage[i];
+    if (!stage_ready[stage]) continue;
+    // Sinks output the collapsed version of their input
+    AudioData &data = *(*node_inputs[i])[0].audio;
+    data.ensure_collapsed();
+    // Earlier stages are behind by the blocks their output is delayed
+    Chunk &target = stage+1 < stage_amount ? sink_delays[stage].chunks[sink_delays[stage].next] : output;
+    kernels::add(target, data.mono);
+  }
+  for (size_t stage = 0; stage < sink_delays.size(); ++stage) {
+    DelayLine &line = sink_delays[stage];
+    line.next = (line.next+1) % line.chunks.size();
+    line.real = stage_ready[stage] ? std::min(line.real+1, line.chunks.size()) : 0;
+  }
+  if (stage_amount > 1) {
+    advance_latches();
+    if (pipeline->filled+1 < stage_amount) pipeline->filled++;
   }
   return output;
 }
 
+size_t NodeTree::get_pipeline_delay() const {
+  return stage_amount-1;
+}
+
+size_t NodeTree::get_unfilled_blocks() const {
+  std::vector<size_t> waits = get_stage_waits();
+  size_t unfilled = 0;
+  for (size_t stage = 0; stage+1 < stage_amount; ++stage) {
+    // Output of the stage comes out delayed, a pause makes a gap
+    const DelayLine &line = pipeline->sink_delays[stage];
+    size_t blocks = waits[stage] > 0 ? waits[stage]+line.chunks.size() : line.chunks.size()-line.real;
+    unfilled = std::max(unfilled, blocks);
+  }
+  return std::max(unfilled, waits[stage_amount-1]);
+}
+
 }
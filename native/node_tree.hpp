@@ -6,14 +6,20 @@
 #include "node.hpp"
 #include "polyphony.hpp"
 #include "data/windows.hpp"
+#include "worker_pool.hpp"
+#include "util/aligned_allocator.hpp"
+#include <atomic>
+#include <memory>
+#include <unordered_map>
 
 namespace audionodes {
 
-class NodeTree {
+class NodeTree : public CacheAligned {
   public:
   struct ConstructionLink { // Used when building a new NodeTree on update
     node_uid from_node, to_node;
     size_t from_socket, to_socket;
+    bool operator==(const ConstructionLink&) const;
   };
   struct Link { // Used during execution
     bool connected;
@@ -21,15 +27,160 @@ class NodeTree {
     Link(bool connected=false, size_t node=0, size_t socket=0);
   };
   
+  // Audio buffers assigned to node outputs. Grows monotonically and is
+  // passed on to following trees, so buffers referenced by a tree stay
+  // valid for as long as the tree exists.
+  struct BufferPool {
+    std::vector<std::unique_ptr<AudioData>> buffers;
+    AudioData* get(size_t);
+  };
+  
   private:
   size_t amount;
   std::vector<Node*> node_evaluation_order;
-  std::vector<NodeInputWindow> node_inputs;
+  std::vector<std::vector<Link>> links;
+  // Windows can be shared with the previous tree (see constructor),
+  // the trees are never evaluated at the same time
+  std::vector<std::shared_ptr<NodeInputWindow>> node_inputs;
+  std::vector<size_t> sinks;
+  std::shared_ptr<BufferPool> buffer_pool;
+  // Data written by each output of each node, bound to the output window
+  // during process. Audio outputs share buffers according to liveness.
+  std::vector<std::vector<Data*>> node_outputs;
   Chunk output;
   
+  // Unit of evaluation: a single node, or a voice group of voice nodes
+  // (see VoiceNode) sharing one variable universe. Groups are evaluated
+  // voice-major, each batch of voices runs through all of the members
+  // before the next one, so the chunks of the voices stay in cache.
+  struct Step {
+    std::vector<size_t> nodes; // In evaluation order
+    bool voice_major = false;
+    // Scratch space of the evaluation
+    std::vector<size_t> voices;
+    std::vector<bool> running;
+    std::unique_ptr<std::atomic<uint64_t>[]> elapsed;
+  };
+  std::vector<Step> steps; // In a valid serial order
+  std::vector<size_t> step_of;
+  
+  // Pipelined evaluation: the steps are split into consecutive stages
+  // which run concurrently, stage k on the block k blocks behind the first
+  // one. Links between stages read latches holding the data of the right
+  // block, variable universes are mirrored into later stages likewise.
+  // The blocks in flight (latches, mirrors and delayed sink output) are
+  // shared with the following tree where it has the same ones, so that an
+  // edit doesn't restart the pipeline.
+  size_t stage_amount = 1;
+  std::vector<size_t> stage_begin; // First step of each stage, and the end
+  std::vector<size_t> node_stage;
+  struct LatchSlots {
+    // Written in turn, the reading sockets are pointed to the oldest
+    std::vector<std::unique_ptr<Data>> slots;
+    size_t next = 0;
+    // Blocks written, up to the amount of slots
+    size_t written = 0;
+  };
+  struct Latch {
+    const Data *source;
+    Node *node;
+    size_t socket, source_stage, stage;
+    std::shared_ptr<LatchSlots> state;
+    std::vector<std::pair<NodeInputWindow*, size_t>> readers;
+    // Mirror of the source's universe in the reading stage
+    const Universe *voices;
+  };
+  std::vector<Latch> latches; // Ordered by stage
+  struct Mirror {
+    const Universe *source;
+    size_t stage;
+    Universe::Pointer mirror;
+    std::vector<Universe> history;
+    size_t next = 0;
+  };
+  std::vector<std::shared_ptr<Mirror>> mirrors; // Ordered by descending stage
+  // Stage of each universe used by the windows
+  std::unordered_map<const Universe*, size_t> universe_stage;
+  // Sink output of each stage, delayed to line up with the last stage
+  struct DelayLine {
+    std::vector<Chunk, AlignedAllocator<Chunk>> chunks;
+    size_t next = 0;
+    // Blocks in a row the stage has run for, up to the length
+    size_t real = 0;
+  };
+  struct Pipeline {
+    // Blocks evaluated so far, counted up to the last stage. A stage waits
+    // until its first block has come through, so nodes start on real input
+    size_t filled = 0;
+    std::vector<DelayLine> sink_delays;
+  };
+  std::shared_ptr<Pipeline> pipeline;
+  // Stages running in the current block: those whose latches are full
+  std::vector<char> stage_ready;
+  
+  // Dependency DAG of the steps, used for parallel evaluation
+  std::vector<std::vector<size_t>> dependents;
+  std::vector<size_t> dependency_count;
+  // Largest amount of steps in one dependency level, i.e. the amount
+  // of steps that can at best be processed simultaneously
+  size_t max_level_width = 0;
+  std::unique_ptr<std::atomic<size_t>[]> remaining_dependencies;
+  std::atomic<size_t> completed;
+  WorkerPool *pool = nullptr;
+  
+  bool is_linked(size_t, size_t) const;
+  // Index of each node in the previous tree, if there is one
+  typedef std::unordered_map<Node*, size_t> PreviousIndex;
+  // Whether the node has the same links as in the previous tree
+  bool has_same_links(size_t, const NodeTree&, size_t) const;
+  // Forms the voice groups given the ancestor sets (bitsets) of the nodes,
+  // every other node becomes a step of its own
+  void form_steps(const std::vector<std::vector<uint64_t>>&, const NodeTree*, const PreviousIndex&);
+  // Orders the steps topologically and derives their dependency DAG
+  void order_steps();
+  // Splits the steps into the given amount of stages (at most), balanced
+  // by the recorded timings of the nodes
+  void assign_stages(size_t, const NodeTree*);
+  Universe::Pointer mirror(const Universe::Pointer&, size_t, const NodeTree*);
+  size_t latch(size_t, size_t, size_t, const NodeTree*);
+  // Blocks until each stage can run
+  std::vector<size_t> get_stage_waits() const;
+  void advance_latches();
+  void point_latch_readers();
+  // Assigns the audio outputs to pooled buffers given the ancestor sets
+  // of the nodes. A buffer is reused once all readers of its previous
+  // contents are guaranteed to have finished, even when nodes are
+  // evaluated in parallel or interleaved within a voice group. Outputs
+  // keep their buffer of the previous tree where possible, so that the
+  // windows reading them can be taken over.
+  void assign_buffers(const std::vector<std::vector<uint64_t>>&, const NodeTree*, const PreviousIndex&);
+  // How much of the previous window of a node can be taken over: all of
+  // it, or the universes and inline values when only the data read
+  // through the links moved to other buffers
+  enum class WindowReuse { none, universes, all };
+  WindowReuse get_window_reuse(size_t, const NodeTree&, size_t, const std::vector<bool>&) const;
+  // Everything before process, false if the node is at rest
+  bool prepare_node(size_t);
+  void process_node(size_t);
+  void process_voice_group(Step&);
+  void process_step(size_t);
+  static void process_step_task(void*, size_t);
+  void evaluate_parallel();
+  static void process_stage_task(void*, size_t);
+  void evaluate_pipelined();
+  
   public:
-  NodeTree(std::vector<Node*>, std::vector<std::vector<Link>>);
-  const Chunk& evaluate();
+  // The input windows (and thereby universes) of nodes whose upstream
+  // subgraph is unchanged are taken over from the previous tree, if given,
+  // along with the blocks in flight between the pipeline stages.
+  NodeTree(std::vector<Node*>, std::vector<std::vector<Link>>, const NodeTree *previous = nullptr, size_t stages = 1);
+  // Nodes are processed on the given pool if there is enough independent work
+  const Chunk& evaluate(WorkerPool *pool = nullptr);
+  // Blocks by which the pipeline delays the output
+  size_t get_pipeline_delay() const;
+  // Blocks still to be evaluated before the output comes from real input,
+  // at most the pipeline delay. Only for the thread evaluating the tree.
+  size_t get_unfilled_blocks() const;
 };
 
 }
@@ -1,4 +1,5 @@
 #include "nodes/collapse.hpp"
+#include "util/kernels.hpp"
 #include <limits>
 
 namespace audionodes {
@@ -16,46 +17,50 @@ Universe::Descriptor Collapse::infer_polyphony_operation(std::vector<Universe::P
 
 void Collapse::process(NodeInputWindow &input) {
   size_t n = input.universes.input->get_channel_amount();
-  Chunk &output = output_window[OutputSockets::audio_out].mono;
+  AudioData &output_data = output_window[OutputSockets::audio_out];
+  Chunk &output = output_data.write_mono();
+  // Constant voices only need the first sample to be flattened
+  size_t length = input[0].is_constant() ? 1 : BLOCK_SIZE;
   switch (get_property_value(Properties::flatten_method)) {
     typedef FlattenMethods FM;
     case FM::sum:
-      output.fill(0);
+      if (input[0].is_silent()) {
+        kernels::fill(output, 0);
+        output_data.set_constant(true);
+        return;
+      }
+      kernels::fill(output, 0);
       for (size_t i = 0; i < n; ++i) {
-        const Chunk &input_chunk = input[0][i];
-        for (size_t j = 0; j < N; ++j) {
-          output[j] += input_chunk[j];
-        }
+        if (!input.is_active(i)) continue;
+        kernels::add(output, input[0][i], length);
       }
       break;
     case FM::maximum:
-      output.fill(-std::numeric_limits<SigT>::infinity());
+      kernels::fill(output, -std::numeric_limits<SigT>::infinity());
       for (size_t i = 0; i < n; ++i) {
-        const Chunk &input_chunk = input[0][i];
-        for (size_t j = 0; j < N; ++j) {
-          output[j] = std::max(output[j], input_chunk[j]);
-        }
+        if (!input.is_active(i)) continue;
+        kernels::max(output, input[0][i], length);
       }
       break;
     case FM::minimum:
-      output.fill(std::numeric_limits<SigT>::infinity());
+      kernels::fill(output, std::numeric_limits<SigT>::infinity());
       for (size_t i = 0; i < n; ++i) {
-        const Chunk &input_chunk = input[0][i];
-        for (size_t j = 0; j < N; ++j) {
-          output[j] = std::min(output[j], input_chunk[j]);
-        }
+        if (!input.is_active(i)) continue;
+        kernels::min(output, input[0][i], length);
       }
       break;
     case FM::product:
-      output.fill(1);
+      kernels::fill(output, 1);
       for (size_t i = 0; i < n; ++i) {
-        const Chunk &input_chunk = input[0][i];
-        for (size_t j = 0; j < N; ++j) {
-          output[j] *= input_chunk[j];
-        }
+        if (!input.is_active(i)) continue;
+        kernels::mul(output, input[0][i], length);
       }
       break;
   }
+  if (length == 1) {
+    kernels::fill(output, output[0]);
+    output_data.set_constant(output[0] == 0);
+  }
 }
 
 }
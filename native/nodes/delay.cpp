@@ -1,34 +1,50 @@
 #include "delay.hpp"
+#include "util/kernels.hpp"
 
 namespace audionodes {
 
 static NodeTypeRegistration<Delay> registration("DelayNode");
 
 Delay::Delay() :
-    Node(SocketTypeList(3, SocketType::audio), {SocketType::audio}, {})
+    VoiceNode(SocketTypeList(3, SocketType::audio), {SocketType::audio}, {})
 {}
 
 void Delay::apply_bundle_universe_changes(const Universe &universe) {
-  universe.apply_delta(bundles);
+  // Keep the blocks of reused slots
+  universe.apply_delta(bundles, [](DynamicBuffer &buffer) { buffer.clear(); });
 }
 
-void Delay::process(NodeInputWindow &input) {
-  size_t n = input.get_channel_amount();
-  AudioData::PolyWriter output(output_window[0], n);
-  
-  for (size_t i = 0; i < n; ++i) {
-    const Chunk
-      &signal = input[InputSockets::signal][i],
-      &delay_time = input[InputSockets::delay_time][i],
-      &feedback = input[InputSockets::feedback][i];
-    bundles[i].process(signal, delay_time, feedback, output[i]);
+bool Delay::is_at_rest(NodeInputWindow &input) {
+  if (!input[InputSockets::signal].is_silent()) return false;
+  for (size_t i = 0; i < bundles.size(); ++i) {
+    if (input.is_active(i) && !bundles[i].is_empty()) return false;
   }
+  return true;
+}
+
+void Delay::begin_voices(NodeInputWindow &input) {
+  silent_input = input[InputSockets::signal].is_silent();
+}
+
+void Delay::process_voice(NodeInputWindow &input, size_t i) {
+  Chunk &output = output_window[0].poly[i];
+  if (silent_input && bundles[i].has_decayed()) {
+    // Nothing audible left to echo
+    bundles[i].clear();
+    kernels::fill(output, 0);
+    return;
+  }
+  const Chunk
+    &signal = input[InputSockets::signal][i],
+    &delay_time = input[InputSockets::delay_time][i],
+    &feedback = input[InputSockets::feedback][i];
+  bundles[i].process(signal, delay_time, feedback, output);
 }
 
 void Delay::DynamicBuffer::process(
     const Chunk &input, const Chunk &delay_time, const Chunk &feedback,
     Chunk &output) {
-  for (size_t i = 0; i < N; ++i) {
+  for (size_t i = 0; i < BLOCK_SIZE; ++i) {
     size_t target_size = std::max(SigT(1), std::round(delay_time[i]*RATE));
     bool grow = size <= target_size, shrink = size >= target_size;
     output[i] = 0;
@@ -55,6 +71,8 @@ void Delay::DynamicBuffer::process(
     }
     if (grow) {
       SigT val = input[i]+output[i]*feedback[i];
+      if (std::abs(val) < silence_threshold) quiet_run++;
+      else quiet_run = 0;
       
       // Push to buffer
       write_head.block->buf[write_head.pos] = val;
@@ -76,6 +94,11 @@ void Delay::DynamicBuffer::process(
   }
 }
 
+void Delay::DynamicBuffer::clear() {
+  read_head = write_head;
+  size = block_dist = quiet_run = 0;
+}
+
 Delay::DynamicBuffer::DynamicBuffer() {
   // Construct initial circular linkage
   Block *first;
@@ -115,9 +138,10 @@ Delay::DynamicBuffer& Delay::DynamicBuffer::operator=(DynamicBuffer &&from) noex
   size = from.size;
   block_amt = from.block_amt;
   block_dist = from.block_dist;
+  quiet_run = from.quiet_run;
   from.read_head = {nullptr, 0};
   from.write_head = {nullptr, 0};
-  from.size = from.block_amt = from.block_dist = 0;
+  from.size = from.block_amt = from.block_dist = from.quiet_run = 0;
   return *this;
 }
 
@@ -7,7 +7,7 @@
 
 namespace audionodes {
 
-class Delay : public Node {
+class Delay : public VoiceNode {
   enum InputSockets {
     signal, delay_time, feedback
   };
@@ -28,9 +28,21 @@ class Delay : public Node {
       size_t pos = 0;
     } read_head, write_head;
     size_t size = 0, block_amt = 0, block_dist = 0;
+    // Amount of most recently pushed samples below silence_threshold
+    size_t quiet_run = 0;
     void dealloc();
     public:
     void process(const Chunk&, const Chunk&, const Chunk&, Chunk&);
+    // Whole content is below silence_threshold
+    inline bool has_decayed() const {
+      return quiet_run >= size;
+    }
+    inline bool is_empty() const {
+      return size == 0;
+    }
+    // Drop the content, equivalent to a buffer of zeros of the same length
+    // since the buffer grows with zeros towards the delay time
+    void clear();
     DynamicBuffer& operator=(DynamicBuffer&&) noexcept;
     DynamicBuffer(DynamicBuffer&&) noexcept;
     DynamicBuffer& operator=(const DynamicBuffer&) = delete;
@@ -41,11 +53,14 @@ class Delay : public Node {
   };
   
   std::vector<DynamicBuffer> bundles;
+  bool silent_input;
   
   public:
   Delay();
   void apply_bundle_universe_changes(const Universe&) override;
-  void process(NodeInputWindow&) override;
+  bool is_at_rest(NodeInputWindow&) override;
+  void begin_voices(NodeInputWindow&) override;
+  void process_voice(NodeInputWindow&, size_t) override;
 };
 
 }
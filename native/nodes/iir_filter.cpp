@@ -1,11 +1,14 @@
 #include "nodes/iir_filter.hpp"
+#include "util/kernels.hpp"
 
 namespace audionodes {
 
 static NodeTypeRegistration<IIRFilter> registration("IIRFilterNode");
 
+const size_t IIRFilter::lanes;
+
 IIRFilter::IIRFilter() :
-    Node(
+    VoiceNode(
       SocketTypeList(4, SocketType::audio),
       {SocketType::audio},
       {PropertyType::select, PropertyType::integer}
@@ -88,6 +91,7 @@ void IIRFilter::Filter::copy_state(const Filter &from) {
     for (size_t i = 0; i < poles; ++i) {
       biquads[i].state[0] = 0;
       biquads[i].state[1] = 0;
+      old_biquads[i] = biquads[i];
     }
     return;
   }
@@ -98,67 +102,248 @@ void IIRFilter::Filter::copy_state(const Filter &from) {
   }
 }
 
-IIRFilter::Lattice IIRFilter::Lattice::interpolate(const Lattice& a, const Lattice& b, FSigT rat) {
-  Lattice n;
-  for (size_t i = 0; i < 2; ++i) {
-    n.k[i] = a.k[i]*(1-rat)+b.k[i]*rat;
+bool IIRFilter::Filter::is_at_rest() const {
+  if (!initialized) return true;
+  for (size_t i = 0; i < poles; ++i) {
+    if (biquads[i].state[0] != 0 || biquads[i].state[1] != 0) return false;
+  }
+  return true;
+}
+
+void IIRFilter::Filter::settle() {
+  for (size_t i = 0; i < poles; ++i) {
+    if (std::abs(biquads[i].state[0]) >= silence_threshold
+        || std::abs(biquads[i].state[1]) >= silence_threshold) return;
   }
-  for (size_t i = 0; i < 3; ++i) {
-    n.v[i] = a.v[i]*(1-rat)+b.v[i]*rat;
+  for (size_t i = 0; i < poles; ++i) {
+    biquads[i].state[0] = biquads[i].state[1] = 0;
   }
-  return n;
 }
 
-void IIRFilter::Filter::process(const Chunk& input, Chunk& output, bool interpolate) {
-  for (size_t i = 0; i < N; ++i) {
-    FSigT in = input[i];
+template<bool interpolate, size_t L>
+void IIRFilter::process_lanes(Filter *const *filters, const bool *interpolating, size_t poles, Block<L> &block) {
+  // Coefficients and state in lane order, null lanes stay zero
+  FSigT k[max_poles][2][L] = {}, v[max_poles][3][L] = {};
+  FSigT old_k[max_poles][2][L] = {}, old_v[max_poles][3][L] = {};
+  FSigT state[max_poles][2][L] = {};
+  for (size_t l = 0; l < L; ++l) {
+    if (!filters[l]) continue;
+    for (size_t j = 0; j < poles; ++j) {
+      const Lattice &lat = filters[l]->biquads[j], &old = filters[l]->old_biquads[j];
+      for (size_t c = 0; c < 2; ++c) {
+        k[j][c][l] = lat.k[c];
+        old_k[j][c][l] = old.k[c];
+        state[j][c][l] = lat.state[c];
+      }
+      for (size_t c = 0; c < 3; ++c) {
+        v[j][c][l] = lat.v[c];
+        old_v[j][c][l] = old.v[c];
+      }
+    }
+  }
+  with_block_size([&](auto n) {
+    for (size_t i = 0; i < n; ++i) {
+      // Lanes that don't interpolate take the new coefficients as is
+      FSigT weight[L];
+      if (interpolate) {
+        const FSigT rat = FSigT(i)/n;
+        for (size_t l = 0; l < L; ++l) weight[l] = interpolating[l] ? rat : 1;
+      }
+      FSigT *in = block.samples[i];
+      for (size_t j = 0; j < poles; ++j) {
+        FSigT *s0 = state[j][0], *s1 = state[j][1];
+        for (size_t l = 0; l < L; ++l) {
+          FSigT k0 = k[j][0][l], k1 = k[j][1][l];
+          FSigT v0 = v[j][0][l], v1 = v[j][1][l], v2 = v[j][2][l];
+          if (interpolate) {
+            const FSigT w = weight[l];
+            k0 = old_k[j][0][l]*(1-w)+k0*w;
+            k1 = old_k[j][1][l]*(1-w)+k1*w;
+            v0 = old_v[j][0][l]*(1-w)+v0*w;
+            v1 = old_v[j][1][l]*(1-w)+v1*w;
+            v2 = old_v[j][2][l]*(1-w)+v2*w;
+          }
+          FSigT nS0 = in[l]+k0*s1[l]+k1*s0[l];
+          FSigT nS1 = s0[l]-k1*nS0;
+          FSigT out = v2*nS0+v1*nS1+v0*(s1[l]-k0*(k0*s1[l]+in[l]));
+          s0[l] = nS0;
+          s1[l] = nS1;
+          in[l] = out;
+        }
+      }
+    }
+  });
+  for (size_t l = 0; l < L; ++l) {
+    if (!filters[l]) continue;
     for (size_t j = 0; j < poles; ++j) {
-      Lattice &l = biquads[j];
-      Lattice c = interpolate ? 
-        Lattice::interpolate(old_biquads[j], biquads[j], FSigT(i)/N) : l;
-      FSigT nS0 = in+c.k[0]*l.state[1]+c.k[1]*l.state[0];
-      FSigT nS1 = l.state[0]-c.k[1]*nS0;
-      FSigT out = c.v[2]*nS0+c.v[1]*nS1+c.v[0]*(l.state[1]-c.k[0]*(c.k[0]*l.state[1]+in));
-      l.state[0] = nS0;
-      l.state[1] = nS1;
-      in = out;
+      filters[l]->biquads[j].state[0] = state[j][0][l];
+      filters[l]->biquads[j].state[1] = state[j][1][l];
     }
-    output[i] = in;
   }
 }
 
-void IIRFilter::process(NodeInputWindow &input) {
-  size_t n = input.get_channel_amount();
-  AudioData::PolyWriter output(output_window[0], n);
-  Modes mode = static_cast<Modes>(get_property_value(Properties::mode));
+bool IIRFilter::is_at_rest(NodeInputWindow &input) {
+  if (!input[InputSockets::input].is_silent()) return false;
+  for (size_t i = 0; i < bundles.size(); ++i) {
+    if (input.is_active(i) && !bundles[i].is_at_rest()) return false;
+  }
+  return true;
+}
+
+void IIRFilter::begin_voices(NodeInputWindow &input) {
+  block_mode = static_cast<Modes>(get_property_value(Properties::mode));
   int poles = get_property_value(Properties::poles);
   if (poles < 0) poles = 0;
   if ((size_t) poles > max_poles) poles = max_poles;
-  for (size_t i = 0; i < n; ++i) {
-    SigT
-      cutoff = input[InputSockets::cutoff][i][0],
-      resonance = input[InputSockets::resonance][i][0],
-      rolloff = input[InputSockets::rolloff][i][0];
-    cutoff = cutoff/RATE*2;
-    // Limit around 10 Hz, below that it starts performing worse
-    if (cutoff < 0.0005) cutoff = 0.0005;
-    if (cutoff > 0.9995) cutoff = 0.9995;
-    cutoff *= M_PI;
-    if (resonance < 0.001) resonance = 0.001;
-    if (rolloff < 0.01) rolloff = 0.01;
-    const Chunk &sig_in = input[InputSockets::input][i];
-    Chunk &sig_out = output[i];
-    Filter &o_filter = bundles[i];
-    if (o_filter.equivalent(mode, poles, cutoff, resonance, rolloff)) {
-      // Parameters haven't changed
-      o_filter.process(sig_in, sig_out, false);
+  block_poles = poles;
+  silent_input = input[InputSockets::input].is_silent();
+  ringing = false;
+}
+
+bool IIRFilter::update_filter(NodeInputWindow &input, size_t i, bool &interpolate) {
+  SigT
+    cutoff = input[InputSockets::cutoff][i][0],
+    resonance = input[InputSockets::resonance][i][0],
+    rolloff = input[InputSockets::rolloff][i][0];
+  cutoff = cutoff/RATE*2;
+  // Limit around 10 Hz, below that it starts performing worse
+  if (cutoff < 0.0005) cutoff = 0.0005;
+  if (cutoff > 0.9995) cutoff = 0.9995;
+  cutoff *= M_PI;
+  if (resonance < 0.001) resonance = 0.001;
+  if (rolloff < 0.01) rolloff = 0.01;
+  Filter &o_filter = bundles[i];
+  interpolate = false;
+  if (o_filter.equivalent(block_mode, block_poles, cutoff, resonance, rolloff)) {
+    // Parameters haven't changed
+    return !silent_input || !o_filter.is_at_rest();
+  }
+  Filter n_filter(block_mode, block_poles, cutoff, resonance, rolloff);
+  n_filter.copy_state(o_filter);
+  interpolate = o_filter.initialized;
+  o_filter = n_filter;
+  return true;
+}
+
+void IIRFilter::process_voices(NodeInputWindow &input, const size_t *voices, size_t count) {
+  // Voices to process, without and with coefficient interpolation
+  size_t grouped[2][batch_size];
+  size_t group_size[2] = {0, 0};
+  for (size_t v = 0; v < count; ++v) {
+    size_t i = voices[v];
+    bool interpolate;
+    if (!update_filter(input, i, interpolate)) {
+      kernels::fill(output_window[0].poly[i], 0);
       continue;
     }
-    Filter n_filter(mode, poles, cutoff, resonance, rolloff);
-    n_filter.copy_state(o_filter);
-    n_filter.process(sig_in, sig_out, o_filter.initialized);
-    o_filter = n_filter;
+    grouped[interpolate][group_size[interpolate]++] = i;
   }
+  for (size_t interpolate = 0; interpolate < 2; ++interpolate) {
+    for (size_t begin = 0; begin < group_size[interpolate]; begin += lanes) {
+      const size_t amount = std::min(lanes, group_size[interpolate]-begin);
+      Filter *filters[lanes] = {};
+      bool interpolating[lanes] = {};
+      const Chunk *sig_in[lanes];
+      Chunk *sig_out[lanes];
+      for (size_t l = 0; l < amount; ++l) {
+        size_t i = grouped[interpolate][begin+l];
+        filters[l] = &bundles[i];
+        interpolating[l] = interpolate;
+        sig_in[l] = &input[InputSockets::input][i];
+        sig_out[l] = &output_window[0].poly[i];
+      }
+      Block<lanes> block;
+      block.gather(sig_in, amount);
+      if (interpolate) {
+        process_lanes<true>(filters, interpolating, block_poles, block);
+      } else {
+        process_lanes<false>(filters, interpolating, block_poles, block);
+      }
+      block.scatter(sig_out, amount);
+      if (silent_input) {
+        // End the tail once it's inaudible
+        for (size_t l = 0; l < amount; ++l) filters[l]->settle();
+        ringing = true;
+      }
+    }
+  }
+}
+
+template<size_t L>
+void IIRFilter::process_group(NodeInputWindow &input, size_t group, const SigT *input_lanes) {
+  const size_t n = input.get_channel_amount();
+  // Inactive and resting voices get null lanes
+  Filter *filters[L] = {};
+  bool interpolating[L] = {};
+  const Chunk *sig_in[L] = {};
+  bool any = false, any_interpolating = false;
+  for (size_t l = 0; l < L; ++l) {
+    size_t i = group*L+l;
+    if (i >= n || !input.is_active(i) || !update_filter(input, i, interpolating[l])) continue;
+    filters[l] = &bundles[i];
+    sig_in[l] = &input[InputSockets::input][i];
+    any = true;
+    any_interpolating |= interpolating[l];
+  }
+  SigT *output = output_window[0].lane_group(group);
+  if (!any) {
+    std::fill(output, output+BLOCK_SIZE*L, 0);
+    return;
+  }
+  Block<L> block;
+  if (input_lanes) {
+    block.load(input_lanes+group*BLOCK_SIZE*L);
+    for (size_t l = 0; l < L; ++l) {
+      if (!filters[l]) block.clear(l);
+    }
+  } else {
+    block.gather(sig_in, L);
+  }
+  if (any_interpolating) {
+    process_lanes<true>(filters, interpolating, block_poles, block);
+  } else {
+    process_lanes<false>(filters, interpolating, block_poles, block);
+  }
+  block.store(output);
+  if (silent_input) {
+    for (size_t l = 0; l < L; ++l) {
+      if (filters[l]) filters[l]->settle();
+    }
+    ringing = true;
+  }
+}
+
+void IIRFilter::process(NodeInputWindow &input) {
+  if (!processes_voice_lanes() || !input.universes.output->is_polyphonic()) {
+    VoiceNode::process(input);
+    return;
+  }
+  const Universe &universe = *input.universes.output;
+  const size_t groups = (universe.get_channel_amount()+VOICE_LANES-1)/VOICE_LANES;
+  begin_voices(input);
+  output_window[0].begin_lanes(universe, VOICE_LANES);
+  // Interleaved like the output if the previous node processes lanes too
+  const SigT *input_lanes = input[InputSockets::input].get_lanes(VOICE_LANES);
+  with_voice_lanes([&](auto width) {
+    for_each_index(input, groups, input.get_channel_amount(), [&](size_t group) {
+      this->process_group<decltype(width)::value>(input, group, input_lanes);
+    });
+  });
+  end_voices(input);
+  output_window[0].end_lanes();
+}
+
+void IIRFilter::end_voices(NodeInputWindow&) {
+  // Silent unless a voice still rings out
+  if (silent_input && !ringing) output_window[0].set_constant(true);
+}
+
+bool IIRFilter::reads_voice_lanes(size_t socket) {
+  return VOICE_LANES && socket == InputSockets::input;
+}
+
+bool IIRFilter::processes_voice_lanes() {
+  return VOICE_LANES != 0;
 }
 
 }
@@ -4,10 +4,12 @@
 
 #include "common.hpp"
 #include "node.hpp"
+#include "util/lane_block.hpp"
+#include <atomic>
 
 namespace audionodes {
 
-class IIRFilter : public Node {
+class IIRFilter : public VoiceNode {
   enum InputSockets {
     input, cutoff, resonance, rolloff
   };
@@ -26,7 +28,6 @@ class IIRFilter : public Node {
   struct Lattice {
     FSigT k[2], v[3];
     FSigT state[2];
-    static Lattice interpolate(const Lattice&, const Lattice&, FSigT);
   };
   struct Filter {
     Lattice biquads[max_poles];
@@ -39,13 +40,41 @@ class IIRFilter : public Node {
     Filter(Modes, size_t, SigT, SigT, SigT);
     bool equivalent(Modes, size_t, SigT, SigT, SigT) const;
     void copy_state(const Filter&);
-    void process(const Chunk&, Chunk&, bool);
+    bool is_at_rest() const;
+    // Clears the state if it has decayed below silence_threshold
+    void settle();
   };
   std::vector<Filter> bundles;
+  // Voices are filtered in lanes of doubles: batches of per-voice chunks
+  // four at a time, or the groups of VOICE_LANES if it's set
+  static const size_t lanes = 4;
+  template<size_t L>
+  using Block = LaneBlock<FSigT, L>;
+  // Advance the filters of the lanes over the block in place, null lanes
+  // stay zero. With interpolate, the coefficients of the lanes flagged
+  // in interpolating move from the old ones over the block.
+  template<bool interpolate, size_t L>
+  static void process_lanes(Filter *const*, const bool *interpolating, size_t poles, Block<L>&);
+  // Bring the filter of the voice up to the parameters of the block, false
+  // if the voice is silent and at rest. interpolate is set if they changed.
+  bool update_filter(NodeInputWindow&, size_t voice, bool &interpolate);
+  template<size_t L>
+  void process_group(NodeInputWindow&, size_t group, const SigT *input_lanes);
+  // Settings of the current block
+  Modes block_mode;
+  size_t block_poles;
+  bool silent_input;
+  std::atomic<bool> ringing;
   
   public:
   IIRFilter();
   void apply_bundle_universe_changes(const Universe&) override;
+  bool is_at_rest(NodeInputWindow&) override;
+  void begin_voices(NodeInputWindow&) override;
+  void process_voices(NodeInputWindow&, const size_t*, size_t) override;
+  void end_voices(NodeInputWindow&) override;
+  bool reads_voice_lanes(size_t) override;
+  bool processes_voice_lanes() override;
   void process(NodeInputWindow&) override;
 };
 
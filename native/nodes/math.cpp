@@ -1,4 +1,6 @@
 #include "nodes/math.hpp"
+#include "util/kernels.hpp"
+#include "util/fast_math.hpp"
 #include <cmath>
 
 namespace audionodes {
@@ -6,59 +8,146 @@ namespace audionodes {
 static NodeTypeRegistration<Math> registration("MathNode");
 
 Math::Math() :
-    Node({SocketType::audio, SocketType::audio}, {SocketType::audio}, {PropertyType::select})
+    VoiceNode({SocketType::audio, SocketType::audio}, {SocketType::audio}, {PropertyType::select, PropertyType::select})
 {}
 
+// Operation table, expanded for both the chunk and the scalar version
+#define MATH_OPERATIONS \
+  X( Add,        a + b ) \
+  X( Subtract,   a - b ) \
+  X( Multiply,   a * b ) \
+  X( Divide,     a / b ) \
+  X( Sine,       std::sin(a) ) \
+  X( Cosine,     std::cos(a) ) \
+  X( Tangent,    std::tan(a) ) \
+  X( Arcsine,    std::asin(a) ) \
+  X( Arccosine,  std::acos(a) ) \
+  X( Arctangent, std::atan(a) ) \
+  X( Power,      std::pow(a, b) ) \
+  X( Logarithm,  std::log(a) / std::log(b) ) \
+  X( Minimum,    std::min(a, b) ) \
+  X( Maximum,    std::max(a, b) ) \
+  X( Round,      std::round(a) ) \
+  X( Less,       a < b ? 1.0 : 0.0 ) \
+  X( Greater,    a > b ? 1.0 : 0.0 ) \
+  X( Modulo,     std::fmod(a, b) ) \
+  X( Absolute,   std::abs(a) )
+
 void Math::compute(Operations operation, const Chunk &_a, const Chunk &_b, Chunk &out) {
   // Placing the switch inside the loop has worse performance. (as of GCC 7.3.0)
   switch (operation) {
     using O = Operations;
-#define X(op) for (size_t i = 0; i < N; ++i) { \
-  out[i] = (op); \
+#define X(name, op) case O::name: for (size_t i = 0; i < BLOCK_SIZE; ++i) { \
+  SigT value = (op); \
+  out[i] = std::isfinite(value) ? value : 0.0; \
 } \
 break;
 #define a _a[i]
 #define b _b[i]
-    case O::Add:        X( a + b )
-    case O::Subtract:   X( a - b )
-    case O::Multiply:   X( a * b )
-    case O::Divide:     X( a / b )
-    case O::Sine:       X( std::sin(a) )
-    case O::Cosine:     X( std::cos(a) )
-    case O::Tangent:    X( std::tan(a) )
-    case O::Arcsine:    X( std::asin(a) )
-    case O::Arccosine:  X( std::acos(a) )
-    case O::Arctangent: X( std::atan(a) )
-    case O::Power:      X( std::pow(a, b) )
-    case O::Logarithm:  X( std::log(a) / std::log(b) )
-    case O::Minimum:    X( std::min(a, b) )
-    case O::Maximum:    X( std::max(a, b) )
-    case O::Round:      X( std::round(a) )
-    case O::Less:       X( a < b ? 1.0 : 0.0 )
-    case O::Greater:    X( a > b ? 1.0 : 0.0 )
-    case O::Modulo:     X( std::fmod(a, b) )
-    case O::Absolute:   X( std::abs(a) )
+    MATH_OPERATIONS
+#undef X
+#undef a
+#undef b
+  }
+}
+
+SigT Math::compute(Operations operation, SigT a, SigT b) {
+  SigT out = 0;
+  switch (operation) {
+    using O = Operations;
+#define X(name, op) case O::name: out = (op); break;
+    MATH_OPERATIONS
+#undef X
+  }
+  return std::isfinite(out) ? out : 0.0;
+}
+
+#undef MATH_OPERATIONS
+
+// Lane versions of the operations, the arithmetic ones are exact
+#define FAST_OPERATIONS \
+  X( Add,        a + b ) \
+  X( Subtract,   a - b ) \
+  X( Multiply,   a * b ) \
+  X( Divide,     a / b ) \
+  X( Sine,       sin(a) ) \
+  X( Cosine,     cos(a) ) \
+  X( Tangent,    tan(a) ) \
+  X( Arcsine,    asin(a) ) \
+  X( Arccosine,  acos(a) ) \
+  X( Arctangent, atan(a) ) \
+  X( Power,      pow(a, b) ) \
+  X( Logarithm,  log_ratio(a, b) ) \
+  X( Minimum,    min(a, b) ) \
+  X( Maximum,    max(a, b) ) \
+  X( Round,      round(a) ) \
+  X( Less,       select(a < b, Lanes(1), Lanes(0)) ) \
+  X( Greater,    select(a > b, Lanes(1), Lanes(0)) ) \
+  X( Modulo,     fmod(a, b) ) \
+  X( Absolute,   abs(a) )
+
+void Math::compute_fast(Operations operation, const Chunk &_a, const Chunk &_b, Chunk &out) {
+  using namespace fast_math;
+  const size_t width = Lanes::width;
+  switch (operation) {
+    using O = Operations;
+#define X(name, op) case O::name: for (size_t i = 0; i < BLOCK_SIZE; i += width) { \
+  Lanes value = (op); \
+  select(is_finite(value), value, Lanes(0)).store(&out[i]); \
+} \
+break;
+#define a Lanes::load(&_a[i])
+#define b Lanes::load(&_b[i])
+    FAST_OPERATIONS
 #undef X
 #undef a
 #undef b
   }
-  for (size_t i = 0; i < N; ++i) {
-    out[i] = std::isfinite(out[i]) ? out[i] : 0.0;
+}
+
+#undef FAST_OPERATIONS
+
+void Math::begin_voices(NodeInputWindow &input) {
+  op = static_cast<Operations>(get_property_value(Properties::math_operator));
+  use_fast = get_property_value(Properties::precision) == Precisions::fast;
+  NodeInputWindow::Socket &in1 = input[InputSockets::val1], &in2 = input[InputSockets::val2];
+  if (op == Operations::Multiply && (in1.is_silent() || in2.is_silent())) {
+    kind = Kind::zero;
+    output_window[0].set_constant(true);
+  } else if (in1.is_constant() && in2.is_constant()) {
+    // Evaluate once per voice
+    kind = Kind::constant;
+    silent = true;
+  } else {
+    kind = Kind::full;
   }
 }
 
-void Math::process(NodeInputWindow &input) {
-  size_t n = input.get_channel_amount();
-  AudioData::PolyWriter output(output_window[0], n);
-  
-  Operations op = static_cast<Operations>(get_property_value(Properties::math_operator));
-  
-  for (size_t i = 0; i < n; ++i) {
-    const Chunk
-      &val1 = input[InputSockets::val1][i],
-      &val2 = input[InputSockets::val2][i];
-    compute(op, val1, val2, output[i]);
+void Math::process_voice(NodeInputWindow &input, size_t i) {
+  NodeInputWindow::Socket &in1 = input[InputSockets::val1], &in2 = input[InputSockets::val2];
+  Chunk &output = output_window[0].poly[i];
+  switch (kind) {
+    case Kind::zero:
+      kernels::fill(output, 0);
+      break;
+    case Kind::constant: {
+      SigT value = compute(op, in1[i][0], in2[i][0]);
+      kernels::fill(output, value);
+      if (value != 0) silent = false;
+      break;
+    }
+    case Kind::full:
+      if (use_fast) {
+        compute_fast(op, in1[i], in2[i], output);
+      } else {
+        compute(op, in1[i], in2[i], output);
+      }
+      break;
   }
 }
 
+void Math::end_voices(NodeInputWindow&) {
+  if (kind == Kind::constant) output_window[0].set_constant(silent);
+}
+
 }
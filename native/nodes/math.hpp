@@ -5,15 +5,19 @@
 #include "common.hpp"
 #include "node.hpp"
 #include <functional>
+#include <atomic>
 
 namespace audionodes {
 
-class Math : public Node {
+class Math : public VoiceNode {
   enum InputSockets {
     val1, val2
   };
   enum Properties {
-    math_operator
+    math_operator, precision
+  };
+  enum Precisions {
+    precise, fast
   };
   enum class Operations {
     Add = 0, Subtract, Multiply, Divide,
@@ -25,10 +29,23 @@ class Math : public Node {
     Modulo, Absolute
   };
   static void compute(Operations, const Chunk&, const Chunk&, Chunk&);
+  // SIMD approximations (util/fast_math.hpp)
+  static void compute_fast(Operations, const Chunk&, const Chunk&, Chunk&);
+  static SigT compute(Operations, SigT, SigT);
+  // Evaluation of the current block
+  enum class Kind {
+    zero, constant, full
+  };
+  Operations op;
+  bool use_fast;
+  Kind kind;
+  std::atomic<bool> silent;
 
   public:
   Math();
-  void process(NodeInputWindow&) override;
+  void begin_voices(NodeInputWindow&) override;
+  void process_voice(NodeInputWindow&, size_t) override;
+  void end_voices(NodeInputWindow&) override;
 };
 
 }
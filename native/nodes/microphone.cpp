@@ -1,4 +1,5 @@
 #include "microphone.hpp"
+#include "util/kernels.hpp"
 #include <iostream>
 
 namespace audionodes {
@@ -10,11 +11,11 @@ void Microphone::callback(void *userdata, Uint8 *_stream, int len) {
   if (!node->mark_connected) return;
   float *stream = (float*)_stream;
   len /= sizeof(float);
-  int amt = len/N;
+  int amt = len/BLOCK_SIZE;
   int si = 0;
   for (int i = 0; i < amt; i++) {
     Chunk buf;
-    for (size_t j = 0; j < N && si < len; ++j, ++si) {
+    for (size_t j = 0; j < BLOCK_SIZE && si < len; ++j, ++si) {
       buf[j] = stream[si];
     }
     node->q.push(buf);
@@ -29,7 +30,7 @@ Microphone::Microphone() :
   want.freq = RATE;
   want.format = AUDIO_F32SYS;
   want.channels = 1;
-  want.samples = N;
+  want.samples = BLOCK_SIZE;
   want.callback = callback;
   want.userdata = this;
   
@@ -50,11 +51,11 @@ void Microphone::connect_callback() {
 }
 
 void Microphone::process(NodeInputWindow &input) {
-  Chunk &output = output_window[0].mono;
+  Chunk &output = output_window[0].write_mono();
   if (!q.empty()) {
     output = q.pop();
   } else {
-    output.fill(0);
+    kernels::fill(output, 0);
   }
 }
 
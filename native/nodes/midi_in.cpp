@@ -29,12 +29,14 @@ int MidiIn::handle_midi_event(void* _node, fluid_midi_event_t* event){
     if (node->event_buffer.full()) {
       // Signal buffer overflow
       node->overflow_flag = true;
+      get_engine_health().record_midi_overflow();
       std::clog << "Audionodes native: Buffer overflow at MIDI input!" << std::endl;
     } else {
       node->event_buffer.push(our_event);
     }
   } else {
     // Node hasn't responded to overflow yet, can't do anything
+    get_engine_health().record_midi_overflow();
   }
   return 0;
 }
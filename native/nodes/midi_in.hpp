@@ -6,6 +6,7 @@
 #include "node.hpp"
 #include "data/midi.hpp"
 #include "util/circular_buffer.hpp"
+#include "engine_health.hpp"
 
 #include "fluidsynth.h"
 #include <iostream>
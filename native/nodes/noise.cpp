@@ -14,11 +14,12 @@ Noise::Noise() :
 
 void Noise::process(NodeInputWindow &input) {
   size_t n = input.get_channel_amount();
-  AudioData::PolyWriter output(output_window[0], n);
+  AudioData::PolyWriter output(output_window[0], *input.universes.output);
   for (size_t i = 0; i < n; ++i) {
+    if (!input.is_active(i)) continue;
     Chunk &channel = output[i];
     const Chunk &vol = input[0][i];
-    for (size_t j = 0; j < N; ++j) {
+    for (size_t j = 0; j < BLOCK_SIZE; ++j) {
       channel[j] = distribution(generator)*vol[j];
     }
   }
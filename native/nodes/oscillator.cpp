@@ -1,11 +1,12 @@
 #include "nodes/oscillator.hpp"
+#include "util/kernels.hpp"
 
 namespace audionodes {
 
 static NodeTypeRegistration<Oscillator> registration("OscillatorNode");
 
 Oscillator::Oscillator() :
-    Node(
+    VoiceNode(
       SocketTypeList(5, SocketType::audio),
       {SocketType::audio},
       {PropertyType::select, PropertyType::boolean}
@@ -51,24 +52,42 @@ void Oscillator::apply_bundle_universe_changes(const Universe &universe) {
   universe.apply_delta(bundles);
 }
 
-void Oscillator::process(NodeInputWindow &input) {
-  size_t n = input.get_channel_amount();
-  AudioData::PolyWriter output(output_window[0], n);
-  
-  const int f_id = get_property_value(Properties::oscillation_func);
-  const int anti_alias = get_property_value(Properties::anti_alias);
-  
-  for (size_t i = 0; i < n; ++i) {
-    const Chunk
-      &frequency = input[InputSockets::frequency][i],
-      &amplitude = input[InputSockets::amplitude][i],
-      &offset    = input[InputSockets::offset][i],
-      &phase     = input[InputSockets::phase][i],
-      &param     = input[InputSockets::param][i];
-    Chunk &channel = output[i];
-    SigT state = bundles[i].state;
-    SigT last_val = bundles[i].last_val;
-    for (size_t j = 0; j < N; ++j) {
+void Oscillator::begin_voices(NodeInputWindow &input) {
+  f_id = get_property_value(Properties::oscillation_func);
+  anti_aliased = get_property_value(Properties::anti_alias);
+  // Without amplitude only the phase has to be kept running, except for
+  // the anti-aliased triangle whose integrator follows the waveform
+  muted = input[InputSockets::amplitude].is_silent()
+    && !(anti_aliased && f_id == Modes::triangle);
+  if (muted && input[InputSockets::offset].is_constant()) {
+    output_window[0].set_constant(input[InputSockets::offset].is_silent());
+  }
+}
+
+void Oscillator::process_voice(NodeInputWindow &input, size_t i) {
+  const Chunk
+    &frequency = input[InputSockets::frequency][i],
+    &amplitude = input[InputSockets::amplitude][i],
+    &offset    = input[InputSockets::offset][i],
+    &phase     = input[InputSockets::phase][i],
+    &param     = input[InputSockets::param][i];
+  Chunk &channel = output_window[0].poly[i];
+  SigT state = bundles[i].state;
+  SigT last_val = bundles[i].last_val;
+  if (muted) {
+    with_block_size([&](auto n) {
+      for (size_t j = 0; j < n; ++j) {
+        state = std::fmod(state + frequency[j]/RATE, 1);
+        if (state < 0) state += 1;
+        if (std::fmod(state + phase[j], 1) < 0) state += 1;
+        channel[j] = offset[j];
+      }
+    });
+    bundles[i].state = state;
+    return;
+  }
+  with_block_size([&](auto n) {
+    for (size_t j = 0; j < n; ++j) {
       SigT step = frequency[j]/RATE;
       state = std::fmod(state + step, 1);
       if (state < 0) state += 1;
@@ -85,14 +104,14 @@ void Oscillator::process(NodeInputWindow &input) {
           channel[j] = phase_st > 1-param[j] ? 1. : -1.;
           break;
         case Modes::triangle:
-          if (anti_alias) {
+          if (anti_aliased) {
             // Will be integrated
             channel[j] = phase_st > 0.5 ? 1. : -1.;
           } else {
             channel[j] = std::fabs(4*phase_st-2)-1;
           }
       }
-      if (anti_alias) {
+      if (anti_aliased) {
         switch (f_id) {
           case Modes::saw:
             channel[j] -= poly_blep(phase_st, step);
@@ -104,17 +123,17 @@ void Oscillator::process(NodeInputWindow &input) {
           case Modes::triangle:
             channel[j] -= poly_blep(phase_st, step);
             channel[j] += poly_blep(std::fmod(phase_st+0.5, 1), step);
-            
+          
             // Leaky integrator
             channel[j] = std::abs(step)*channel[j]*4 + (1-std::abs(step))*last_val;
             last_val = channel[j];
             break;
         }
       }
-      channel[j] = channel[j] * amplitude[j] + offset[j];
     }
-    bundles[i] = {state, last_val};
-  }
+  });
+  kernels::mul_add(channel, amplitude, offset);
+  bundles[i] = {state, last_val};
 }
 
 
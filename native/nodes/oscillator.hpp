@@ -8,7 +8,7 @@
 
 namespace audionodes {
 
-class Oscillator : public Node {
+class Oscillator : public VoiceNode {
   enum InputSockets {
     frequency, amplitude, offset, phase, param
   };
@@ -24,6 +24,9 @@ class Oscillator : public Node {
     SigT state, last_val;
   };
   std::vector<Bundle> bundles;
+  // Settings of the current block
+  int f_id, anti_aliased;
+  bool muted;
 
   static SigT poly_blep(SigT, SigT);
   public:
@@ -31,7 +34,8 @@ class Oscillator : public Node {
   void reset_state();
   Universe::Descriptor infer_polyphony_operation(std::vector<Universe::Pointer>) override;
   void apply_bundle_universe_changes(const Universe&) override;
-  void process(NodeInputWindow&) override;
+  void begin_voices(NodeInputWindow&) override;
+  void process_voice(NodeInputWindow&, size_t) override;
 };
 
 }
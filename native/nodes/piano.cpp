@@ -1,4 +1,5 @@
 #include "nodes/piano.hpp"
+#include "util/kernels.hpp"
 
 namespace audionodes {
 
@@ -12,15 +13,20 @@ Piano::Piano() :
 }
 
 Universe::Descriptor Piano::infer_polyphony_operation(std::vector<Universe::Pointer>) {
-  Universe::Pointer mono(new Universe()), uni(new Universe(true, voices.size()));
+  // Slots are taken over from the current voices in process
+  Universe::Pointer mono(new Universe()), uni(new Universe(true, 0));
   return Universe::Descriptor(mono, mono, uni);
 }
 
 void Piano::process(NodeInputWindow &input) {
-  input.universes.output->ensure(voices.size());
+  Universe &universe = *input.universes.output;
+  universe.ensure(active_slots);
+  universe.begin_update();
   const MidiData &midi = input[InputSockets::midi_in].get<MidiData>();
   SigT decay_time = std::max(SigT(0), input[InputSockets::decay_time][0][0]);
   new_voices.clear();
+  // existing_note may point into new_voices
+  new_voices.reserve(midi.events.size());
   for (const MidiData::Event event : midi.events) {
     unsigned char note = event.get_note();
     switch (event.get_type()) {
@@ -31,6 +37,7 @@ void Piano::process(NodeInputWindow &input) {
           existing_note[note]->stage = VoiceStage::decaying;
         }
         new_voices.push_back({note, SigT(std::pow(2, (note-69)/12.)*440), event.get_velocity()/SigT(127)});
+        new_voices.back().serial = voice_counter++;
         existing_note[note] = &new_voices.back();
         if (!sostenuto) sostenuto_mask[note] = true;
         break;
@@ -59,8 +66,8 @@ void Piano::process(NodeInputWindow &input) {
           if (!sostenuto) {
             check_all_decay();
             sostenuto_mask.fill(false);
-            for (auto &voice : voices) {
-              if (!voice.released) sostenuto_mask[voice.note] = true;
+            for (size_t i = 0; i < voices.size(); ++i) {
+              if (active_slots[i] && !voices[i].released) sostenuto_mask[voices[i].note] = true;
             }
             for (auto &voice : new_voices) {
               if (!voice.released) sostenuto_mask[voice.note] = true;
@@ -72,49 +79,57 @@ void Piano::process(NodeInputWindow &input) {
         break;
     }
   }
-  removed_tmp.clear();
-  voices_tmp.clear();
   for (size_t i = 0; i < voices.size(); ++i) {
+    if (!active_slots[i]) continue;
     if (voices[i].stage == VoiceStage::decaying && voices[i].decaying_for >= size_t(decay_time*RATE)) {
       voices[i].stage = VoiceStage::dead;
     }
     if (voices[i].stage == VoiceStage::dead) {
-      removed_tmp.push_back(i);
+      universe.remove_channel(i);
+      active_slots[i] = false;
+    }
+  }
+  for (const VoiceState &voice : new_voices) {
+    size_t slot = universe.add_channel();
+    if (slot == voices.size()) {
+      voices.push_back(voice);
+      active_slots.push_back(true);
     } else {
-      voices_tmp.push_back(voices[i]);
+      voices[slot] = voice;
+      active_slots[slot] = true;
     }
   }
-  input.universes.output->update(removed_tmp, new_voices.size());
-  voices.clear();
-  size_t n = voices_tmp.size() + new_voices.size();
-  voices.reserve(n);
   existing_note.fill(nullptr);
-  for (VoiceState voice : voices_tmp) {
-    voices.push_back(voice);
-    existing_note[voice.note] = &voices.back();
-  }
-  for (VoiceState voice : new_voices) {
-    voices.push_back(voice);
-    existing_note[voice.note] = &voices.back();
+  for (size_t i = 0; i < voices.size(); ++i) {
+    if (!active_slots[i]) continue;
+    VoiceState *&existing = existing_note[voices[i].note];
+    if (!existing || existing->serial < voices[i].serial) existing = &voices[i];
   }
   AudioData::PolyWriter
-    frequency(output_window[OutputSockets::frequency], n),
-    velocity(output_window[OutputSockets::velocity], n),
-    runtime(output_window[OutputSockets::runtime], n),
-    decay(output_window[OutputSockets::decay], n);
-  for (size_t i = 0; i < n; ++i) {
+    frequency(output_window[OutputSockets::frequency], universe),
+    velocity(output_window[OutputSockets::velocity], universe),
+    runtime(output_window[OutputSockets::runtime], universe),
+    decay(output_window[OutputSockets::decay], universe);
+  // Frequency and velocity are held for the whole block
+  output_window[OutputSockets::frequency].set_constant();
+  output_window[OutputSockets::velocity].set_constant();
+  bool any_decaying = false;
+  for (size_t i = 0; i < voices.size(); ++i) {
+    if (!active_slots[i]) continue;
     VoiceState &voice = voices[i];
-    frequency[i].fill(voice.freq);
-    velocity[i].fill(voice.velocity);
-    for (size_t j = 0; j < N; ++j) {
+    kernels::fill(frequency[i], voice.freq);
+    kernels::fill(velocity[i], voice.velocity);
+    for (size_t j = 0; j < BLOCK_SIZE; ++j) {
       runtime[i][j] = SigT(voice.age++)/RATE;
     }
     if (voice.stage == VoiceStage::decaying) {
-      for (size_t j = 0; j < N; ++j) {
+      any_decaying = true;
+      for (size_t j = 0; j < BLOCK_SIZE; ++j) {
         decay[i][j] = std::max(SigT(0), (decay_time*RATE-SigT(voice.decaying_for++))/(decay_time*RATE));
       }
-    } else decay[i].fill(1);
+    } else kernels::fill(decay[i], 1);
   }
+  if (!any_decaying) output_window[OutputSockets::decay].set_constant();
 }
 
 void Piano::check_all_decay() {
@@ -24,10 +24,15 @@ class Piano : public Node {
       active, decaying, dead
     } stage;
     bool released = false;
+    // Order of creation, the newest voice of a note receives its events
+    unsigned long long serial = 0;
   };
   using VoiceStage = VoiceState::Stage;
-  std::vector<VoiceState> voices, new_voices, voices_tmp;
-  std::vector<size_t> removed_tmp;
+  // Indexed by the slots of the output universe
+  std::vector<VoiceState> voices;
+  std::vector<bool> active_slots;
+  std::vector<VoiceState> new_voices;
+  unsigned long long voice_counter = 0;
   // null when note doesn't exist, otherwise pointer to VoiceState
   std::array<VoiceState*, 128> existing_note;
   bool sustain = false;
@@ -1,4 +1,5 @@
 #include "nodes/pitch_bend.hpp"
+#include "util/kernels.hpp"
 
 namespace audionodes {
 
@@ -15,7 +16,8 @@ Universe::Descriptor PitchBend::infer_polyphony_operation(std::vector<Universe::
 }
 
 void PitchBend::process(NodeInputWindow &input) {
-  Chunk &bend = output_window[0].mono;
+  AudioData &output = output_window[0];
+  Chunk &bend = output.write_mono();
   const MidiData &midi = input[InputSockets::midi_in].get<MidiData>();
   SigT new_state = bend_state;
   for (const MidiData::Event event : midi.events) {
@@ -25,12 +27,10 @@ void PitchBend::process(NodeInputWindow &input) {
   }
 
   if (bend_state == new_state) {
-    bend.fill(bend_state);
+    kernels::fill(bend, bend_state);
+    output.set_constant(bend_state == 0);
   } else {
-    for (size_t j = 0; j < N; ++j) {
-      SigT result = (bend_state*(N-j) + new_state*j)/N;
-      bend[j] = result;
-    }
+    kernels::ramp(bend, bend_state, new_state);
     bend_state = new_state;
   }
 }
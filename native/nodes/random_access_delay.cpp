@@ -1,4 +1,5 @@
 #include "random_access_delay.hpp"
+#include "util/kernels.hpp"
 
 namespace audionodes {
 
@@ -9,17 +10,27 @@ RandomAccessDelay::RandomAccessDelay() :
 {}
 
 void RandomAccessDelay::apply_bundle_universe_changes(const Universe &universe) {
-  universe.apply_delta(bundles);
+  // Keep the buffers of reused slots
+  universe.apply_delta(bundles, [](Bundle &bundle) { bundle.reset(); });
+}
+
+bool RandomAccessDelay::is_at_rest(NodeInputWindow &input) {
+  if (!input[InputSockets::signal].is_silent()) return false;
+  for (size_t i = 0; i < bundles.size(); ++i) {
+    if (input.is_active(i) && !bundles[i].resting) return false;
+  }
+  return true;
 }
 
 void RandomAccessDelay::process(NodeInputWindow &input) {
   size_t n = input.get_channel_amount();
-  AudioData::PolyWriter output(output_window[0], n);
+  AudioData::PolyWriter output(output_window[0], *input.universes.output);
   
   // Ugh, float properties not supported yet
   const size_t buffer_size =
     std::max(4096, get_property_value(Properties::buffer_size)*RATE);
-  for (size_t i = 0; i < n; ++i) {
+  const bool silent_input = input[InputSockets::signal].is_silent();
+  for_each_voice(input, n, [&](size_t i) {
     const Chunk
       &signal = input[InputSockets::signal][i],
       &delay_time = input[InputSockets::delay_time][i],
@@ -27,7 +38,17 @@ void RandomAccessDelay::process(NodeInputWindow &input) {
     Chunk &chunk = output[i];
     auto &bundle = bundles[i];
     bundle.resize(buffer_size);
-    for (size_t j = 0; j < N; ++j) {
+    if (silent_input && bundle.quiet_run >= buffer_size) {
+      // Nothing audible left to echo, zero the remains once
+      if (!bundle.resting) {
+        std::fill(bundle.buffer.begin(), bundle.buffer.end(), 0);
+        bundle.resting = true;
+      }
+      kernels::fill(chunk, 0);
+      return;
+    }
+    bundle.resting = false;
+    for (size_t j = 0; j < BLOCK_SIZE; ++j) {
       SigT time = std::floor(delay_time[j]*RATE);
       if (time < 1) time = 1;
       if (time > buffer_size-2) time = buffer_size-2;
@@ -43,15 +64,26 @@ void RandomAccessDelay::process(NodeInputWindow &input) {
       chunk[j] = v1+std::fmod(delay_time[j]*RATE, 1)*(v2-v1);
       if (!std::isfinite(chunk[j])) chunk[j] = 0;
       SigT fbval = signal[j]+chunk[j]*feedback[j];
+      if (std::abs(fbval) < silence_threshold) bundle.quiet_run++;
+      else bundle.quiet_run = 0;
       bundle.buffer[bundle.write_head] = fbval;
       bundle.write_head++;
       if (bundle.write_head == buffer_size) bundle.write_head = 0;
     }
-  }
+  });
+}
+
+void RandomAccessDelay::Bundle::reset() {
+  std::fill(buffer.begin(), buffer.end(), 0);
+  write_head = 0;
+  quiet_run = buffer.size();
+  resting = false;
 }
 
 void RandomAccessDelay::Bundle::resize(size_t size) {
   if (size != buffer.size()) {
+    // A fresh buffer holds only zeros
+    if (buffer.empty()) quiet_run = size;
     buffer.resize(size);
     write_head %= size;
   }
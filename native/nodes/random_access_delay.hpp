@@ -21,7 +21,12 @@ class RandomAccessDelay : public Node {
   struct Bundle {
     std::vector<SigT> buffer;
     size_t write_head = 0;
+    // Amount of most recently written samples below silence_threshold
+    size_t quiet_run = 0;
+    // Buffer has been zeroed after decaying, processing is skipped
+    bool resting = false;
     void resize(size_t);
+    void reset();
   };
   
   std::vector<Bundle> bundles;
@@ -29,6 +34,7 @@ class RandomAccessDelay : public Node {
   public:
   RandomAccessDelay();
   void apply_bundle_universe_changes(const Universe&) override;
+  bool is_at_rest(NodeInputWindow&) override;
   void process(NodeInputWindow&) override;
 };
 
@@ -1,4 +1,5 @@
 #include "nodes/sampler.hpp"
+#include "util/kernels.hpp"
 
 #include <iostream>
 
@@ -78,24 +79,26 @@ void Sampler::process(NodeInputWindow &input) {
     }
   }
 
-  Chunk &value = output_window[0].mono;
+  AudioData &output = output_window[0];
+  Chunk &value = output.write_mono();
 
   // If no file is loaded or the file is not being played, send an empty signal
   if (!loaded || !running || playhead > size) {
-    value.fill(0);
+    kernels::fill(value, 0);
+    output.set_constant(true);
   } else {
     // Read from the file either until the end of the chunk or until the end of the file
-    for (size_t j = 0; j < N; ++j) {
+    for (size_t j = 0; j < BLOCK_SIZE; ++j) {
       value[j] = buff[(playhead + j)%size];
     }
 
     // Fill the rest with zeroes
-    if (size-playhead < N && get_property_value(Properties::mode) == 0) {
-      for (size_t j = size-playhead; j < N; ++j) value[j] = 0;
+    if (size-playhead < BLOCK_SIZE && get_property_value(Properties::mode) == 0) {
+      for (size_t j = size-playhead; j < BLOCK_SIZE; ++j) value[j] = 0;
     }
 
     // Advance the playhead and maybe end playback
-    playhead += N;
+    playhead += BLOCK_SIZE;
     if (playhead >= size) {
       if(get_property_value(Properties::mode) == 0){
         playhead = 0;
@@ -1,4 +1,5 @@
 #include "nodes/slider.hpp"
+#include "util/kernels.hpp"
 
 namespace audionodes {
 
@@ -18,7 +19,8 @@ void Slider::process(NodeInputWindow &input) {
   int channel = get_property_value(Properties::channel);
   int interfaceType = get_property_value(Properties::interfaceType);
   static const int controlMask[] = {7, 10};
-  Chunk &value = output_window[0].mono;
+  AudioData &output = output_window[0];
+  Chunk &value = output.write_mono();
   const MidiData &midi = input[InputSockets::midi_in].get<MidiData>();
   SigT new_state = value_state;
   for (const MidiData::Event event : midi.events) {
@@ -28,12 +30,10 @@ void Slider::process(NodeInputWindow &input) {
   }
 
   if (value_state == new_state) {
-    value.fill(value_state);
+    kernels::fill(value, value_state);
+    output.set_constant(value_state == 0);
   } else {
-    for (size_t j = 0; j < N; ++j) {
-      SigT result = (value_state*(N-j) + new_state*j)/N;
-      value[j] = result;
-    }
+    kernels::ramp(value, value_state, new_state);
     value_state = new_state;
   }
 }
@@ -1,4 +1,5 @@
 #include "nodes/toggle.hpp"
+#include "util/kernels.hpp"
 
 namespace audionodes {
 
@@ -13,20 +14,21 @@ void Toggle::process(NodeInputWindow &input) {
   auto &s_b = input[InputSockets::signal_b];
   auto &triggers = input[InputSockets::trigger].get<TriggerData>();
   size_t n = input.get_channel_amount();
-  AudioData::PolyWriter output(output_window[0], n);
-  for(size_t i = 0; i < n; i++){
-    bool state = a_on;
-    size_t k = 0;
-    for(size_t j = 0; j < N; j++){
-      if(k < triggers.events.size() && triggers.events[k] <= j){
-        state = !state;
-        k++;
-      }
-      if(state)
-        output[i][j] = s_a[i][j];
-      else
-        output[i][j] = s_b[i][j];
+  AudioData::PolyWriter output(output_window[0], *input.universes.output);
+  // The triggers are the same for every voice, so is the choice of signal
+  Chunk choose_a;
+  bool state = a_on;
+  size_t k = 0;
+  for(size_t j = 0; j < BLOCK_SIZE; j++){
+    if(k < triggers.events.size() && triggers.events[k] <= j){
+      state = !state;
+      k++;
     }
+    choose_a[j] = state;
+  }
+  for(size_t i = 0; i < n; i++){
+    if (!input.is_active(i)) continue;
+    kernels::select(output[i], choose_a, s_a[i], s_b[i]);
   }
   a_on ^= triggers.events.size() % 2;
 }
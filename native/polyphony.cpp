@@ -17,7 +17,9 @@ Universe::Universe(bool variable) :
 Universe::Universe(bool variable, size_t channels) :
     unique_token(token_counter++),
     variable(variable),
-    channel_amount(channels)
+    channel_amount(channels),
+    old_channel_amount(channels),
+    active(channels, true)
 {}
 
 bool Universe::is_polyphonic() const {
@@ -45,38 +47,54 @@ bool Universe::operator!=(const Universe &other) const {
   return !operator==(other);
 }
 
-void Universe::ensure(size_t expected) {
-  if (channel_amount != expected) {
-    old_channel_amount = channel_amount;
-    channel_amount = expected;
-    added_channels_amount = 0;
-    removed_channels_amount = 0;
-  }
+Universe Universe::blank_copy() const {
+  Universe blank(variable);
+  blank.unique_token = unique_token;
+  return blank;
 }
 
-void Universe::update(std::vector<bool> removed, size_t added) {
-  channel_removed = removed;
-  old_channel_amount = channel_amount;
-  added_channels_amount = added;
-  channel_amount += added;
-  removed_channels_amount = 0;
-  if (removed.size()) {
-    for (bool r : removed) {
-      if (r) removed_channels_amount++;
-    }
+void Universe::copy_slots(const Universe &other) {
+  channel_amount = other.channel_amount;
+  old_channel_amount = other.old_channel_amount;
+  active = other.active;
+  free_slots = other.free_slots;
+  added_channels = other.added_channels;
+}
+
+void Universe::ensure(const std::vector<bool> &slots) {
+  if (active == slots) return;
+  active = slots;
+  channel_amount = old_channel_amount = slots.size();
+  free_slots.clear();
+  // Lowest slots are taken first
+  for (size_t i = slots.size(); i-- > 0;) {
+    if (!slots[i]) free_slots.push_back(i);
   }
+  added_channels.clear();
 }
 
-void Universe::update(std::vector<size_t> removed, size_t added) {
+void Universe::begin_update() {
   old_channel_amount = channel_amount;
-  added_channels_amount = added;
-  removed_channels_amount = removed.size();
-  if (removed_channels_amount > 0) {
-     channel_removed = std::vector<bool>(old_channel_amount, false);
-     for (size_t idx : removed) channel_removed[idx] = true;
+  added_channels.clear();
+}
+
+size_t Universe::add_channel() {
+  size_t channel;
+  if (free_slots.empty()) {
+    channel = channel_amount++;
+    active.push_back(true);
+  } else {
+    channel = free_slots.back();
+    free_slots.pop_back();
+    active[channel] = true;
   }
-  channel_amount += added_channels_amount;
-  channel_amount -= removed_channels_amount;
+  added_channels.push_back(channel);
+  return channel;
+}
+
+void Universe::remove_channel(size_t channel) {
+  active[channel] = false;
+  free_slots.push_back(channel);
 }
 
 Universe::Descriptor::Descriptor() {
@@ -8,14 +8,17 @@
 namespace audionodes {
 
 class Universe {
-  // Describes how the universe changed from the last chunk
-  // (which channels were removed and how many new channels were initialized)
-  // and uniquely correlates polyphony sources to prevent unwanted mixing
+  // Channels of a variable universe are slots with stable indices: a
+  // voice keeps its slot until it ends, after which the slot is free to
+  // be reused. Describes which slots were taken by the last update and
+  // uniquely correlates polyphony sources to prevent unwanted mixing.
   static int token_counter;
   int unique_token;
   bool variable;
-  size_t channel_amount = 0, old_channel_amount = 0, added_channels_amount = 0, removed_channels_amount = 0;
-  std::vector<bool> channel_removed;
+  // Amount of slots, including inactive ones
+  size_t channel_amount = 0, old_channel_amount = 0;
+  std::vector<bool> active;
+  std::vector<size_t> free_slots, added_channels;
   
   public:
   typedef std::shared_ptr<Universe> Pointer;
@@ -29,55 +32,55 @@ class Universe {
   
   size_t get_channel_amount() const;
   
+  inline bool is_active(size_t channel) const {
+    return !variable || active[channel];
+  }
+  
   bool operator==(const Universe&) const;
   bool operator!=(const Universe&) const;
- 
-  // Reset if channel_amount isn't the expected value
-  void ensure(size_t);
   
-  // Removal by lookup-table
-  void update(std::vector<bool> removed, size_t added);
-  // Removal by indices
-  void update(std::vector<size_t> removed, size_t added);
+  // Equal to this universe but without any slots. Reads only what is
+  // fixed at construction, so it's safe while the universe is updated
+  Universe blank_copy() const;
+  // Take over the slots (and the last update) of an equal universe,
+  // leaving what is fixed at construction untouched
+  void copy_slots(const Universe&);
+  
+  // Replace the slots with the given set (of which the active ones are
+  // true), if they don't match already
+  void ensure(const std::vector<bool>&);
   
-  template<class T>
-  void apply_delta(std::vector<T> &apply_to) const {
-    if (variable) {
-      if (old_channel_amount == apply_to.size()) {
-        if (removed_channels_amount > 0) {
-          size_t replace_idx = 0;
-          for (size_t i = 0; i < old_channel_amount; ++i) {
-            if (!channel_removed[i]) {
-              if (replace_idx != i) apply_to[replace_idx] = std::move(apply_to[i]);
-              replace_idx++;
-            }
-          }
-          apply_to.resize(replace_idx);
-        }
-        apply_to.reserve(channel_amount);
-        // Add new channels
-        for (size_t i = 0; i < added_channels_amount; ++i) {
-          apply_to.emplace_back();
-        }
-      } else {
-        // Not compatible with previus state of the universe, recreate
-        apply_to.clear();
-        for (size_t i = 0; i < channel_amount; ++i) {
-          apply_to.emplace_back();
-        }
+  // Start describing the changes of a new chunk
+  void begin_update();
+  // Take a free slot (or a new one) for a voice, returns its index
+  size_t add_channel();
+  void remove_channel(size_t);
+  
+  // Bring per-channel state up to date. Slots taken by the last update
+  // are reset with reset(T&), removed slots are left as they are.
+  // Storage only grows when the amount of slots does.
+  template<class T, class A, class F>
+  void apply_delta(std::vector<T, A> &apply_to, F reset) const {
+    if (variable && old_channel_amount == apply_to.size()) {
+      for (size_t channel : added_channels) {
+        if (channel < apply_to.size()) reset(apply_to[channel]);
+      }
+      while (apply_to.size() < channel_amount) {
+        apply_to.emplace_back();
       }
-    } else {
-      // Invariable -- ensure the correct constant amount of channels is present
-      if (apply_to.size() != channel_amount) {
-        apply_to.clear();
-        apply_to.reserve(channel_amount);
-        for (size_t i = 0; i < channel_amount; ++i) {
-          apply_to.emplace_back();
-        }
-        apply_to.shrink_to_fit();
+    } else if (apply_to.size() != channel_amount) {
+      // Not compatible with the previous state of the universe, recreate
+      apply_to.clear();
+      apply_to.reserve(channel_amount);
+      for (size_t i = 0; i < channel_amount; ++i) {
+        apply_to.emplace_back();
       }
     }
   }
+  template<class T, class A>
+  void apply_delta(std::vector<T, A> &apply_to) const {
+    apply_delta(apply_to, [](T &value) { value = T(); });
+  }
   struct Descriptor {
     Pointer input, bundles, output;
     Descriptor(); // All mono
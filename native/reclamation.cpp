@@ -0,0 +1,50 @@
+#include "reclamation.hpp"
+
+namespace audionodes {
+
+EpochReclaimer::EpochReclaimer() :
+    global_epoch(0),
+    finished_epoch(0)
+{}
+
+EpochReclaimer::~EpochReclaimer() {
+  reclaim_all();
+}
+
+uint64_t EpochReclaimer::enter() {
+  return global_epoch.load();
+}
+
+void EpochReclaimer::exit(uint64_t epoch) {
+  finished_epoch.store(epoch);
+}
+
+void EpochReclaimer::retire(std::function<void()> deleter) {
+  // The reader loads published pointers only after reading the epoch,
+  // so a pass that sees this epoch can't see the retired object anymore
+  uint64_t epoch = ++global_epoch;
+  retired.push_back({epoch, deleter});
+}
+
+void EpochReclaimer::reclaim() {
+  uint64_t finished = finished_epoch.load();
+  size_t kept = 0;
+  for (size_t i = 0; i < retired.size(); ++i) {
+    if (retired[i].epoch <= finished) {
+      retired[i].deleter();
+    } else {
+      if (kept != i) retired[kept] = std::move(retired[i]);
+      kept++;
+    }
+  }
+  retired.resize(kept);
+}
+
+void EpochReclaimer::reclaim_all() {
+  for (Retired &object : retired) {
+    object.deleter();
+  }
+  retired.clear();
+}
+
+}
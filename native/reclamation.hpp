@@ -0,0 +1,46 @@
+
+#ifndef RECLAMATION_HPP
+#define RECLAMATION_HPP
+
+#include "common.hpp"
+#include <atomic>
+#include <functional>
+
+namespace audionodes {
+
+// Epoch based deferred deletion for objects shared with the execution
+// thread (the single reader). The reader brackets every pass with
+// enter/exit and never waits for anything; the writer retires objects
+// after unpublishing them and they are deleted only once the reader has
+// finished a pass that started after the retirement.
+class EpochReclaimer {
+  struct Retired {
+    uint64_t epoch;
+    std::function<void()> deleter;
+  };
+  std::atomic<uint64_t> global_epoch, finished_epoch;
+  std::vector<Retired> retired;
+  
+  public:
+  // Reader: call before loading any published pointer, pass the result to exit
+  uint64_t enter();
+  void exit(uint64_t);
+  
+  // Writer: call after the object has been unpublished
+  void retire(std::function<void()>);
+  template<class T>
+  void retire(T *object) {
+    if (object) retire([object]() { delete object; });
+  }
+  // Delete everything the reader can no longer be using
+  void reclaim();
+  // Delete everything, only when there is no reader anymore
+  void reclaim_all();
+  
+  EpochReclaimer();
+  ~EpochReclaimer();
+};
+
+}
+
+#endif
@@ -0,0 +1,76 @@
+#include "render_thread.hpp"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace audionodes {
+
+constexpr size_t RenderThread::max_look_ahead;
+
+void RenderThread::thread_main() {
+  Chunk chunk;
+  while (running) {
+    if (queue.size() >= look_ahead) {
+      primed = true;
+      // The callback notifies without holding the mutex (it must never
+      // block), so a wakeup may be missed -> poll with a timeout
+      std::unique_lock<std::mutex> lock(sleep_mutex);
+      sleep_cv.wait_for(lock, std::chrono::milliseconds(1));
+      continue;
+    }
+    render(chunk);
+    queue.push(chunk);
+  }
+}
+
+bool RenderThread::pop(Chunk &chunk) {
+  bool available = !queue.empty();
+  if (available) {
+    chunk = queue.pop();
+  } else {
+    chunk.fill(0);
+  }
+  sleep_cv.notify_one();
+  return available;
+}
+
+bool RenderThread::is_primed() const {
+  return primed;
+}
+
+size_t RenderThread::get_look_ahead() const {
+  return look_ahead;
+}
+
+RenderThread::RenderThread(size_t look_ahead, RenderFunction render) :
+    look_ahead(std::min(std::max(look_ahead, size_t(1)), max_look_ahead)),
+    render(render),
+    running(false),
+    primed(false)
+{}
+
+void RenderThread::start() {
+  if (running) return;
+  running = true;
+  thread = std::thread(&RenderThread::thread_main, this);
+#ifdef __linux__
+  // Realtime priority usually requires privileges, stay at normal priority otherwise
+  sched_param param;
+  param.sched_priority = sched_get_priority_min(SCHED_FIFO)+1;
+  pthread_setschedparam(thread.native_handle(), SCHED_FIFO, &param);
+#endif
+}
+
+void RenderThread::stop() {
+  running = false;
+  sleep_cv.notify_all();
+  if (thread.joinable()) thread.join();
+}
+
+RenderThread::~RenderThread() {
+  stop();
+}
+
+}
@@ -0,0 +1,56 @@
+
+#ifndef RENDER_THREAD_HPP
+#define RENDER_THREAD_HPP
+
+#include "common.hpp"
+#include "util/circular_buffer.hpp"
+#include "util/aligned_allocator.hpp"
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace audionodes {
+
+// Evaluates chunks ahead of time on a dedicated (high priority) thread,
+// so that the audio callback only has to copy them out. A spike in the
+// cost of one chunk is absorbed by the queued chunks instead of causing
+// a dropout, at the price of look_ahead chunks of latency.
+// The thread only evaluates between start() and stop(), the owner has to
+// make sure no other thread evaluates in that time.
+class RenderThread : public CacheAligned {
+  public:
+  typedef void (*RenderFunction)(Chunk&);
+  static constexpr size_t max_look_ahead = 32;
+  
+  private:
+  // One slot is always left empty by CircularBuffer
+  CircularBuffer<Chunk, max_look_ahead+1> queue;
+  size_t look_ahead;
+  RenderFunction render;
+  std::atomic<bool> running;
+  // Whether the queue has been filled once, running dry before
+  // that doesn't count as an xrun
+  std::atomic<bool> primed;
+  std::mutex sleep_mutex;
+  std::condition_variable sleep_cv;
+  std::thread thread;
+  
+  void thread_main();
+  
+  public:
+  // Begin/end rendering, stop() returns once the last chunk is done
+  void start();
+  void stop();
+  // Audio callback: take the next chunk, false (and silence) if none was ready
+  bool pop(Chunk&);
+  bool is_primed() const;
+  size_t get_look_ahead() const;
+  
+  RenderThread(size_t look_ahead, RenderFunction);
+  ~RenderThread();
+};
+
+}
+
+#endif
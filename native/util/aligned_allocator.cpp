@@ -0,0 +1,29 @@
+#include "util/aligned_allocator.hpp"
+#include <new>
+
+namespace audionodes {
+
+void* allocate_aligned(size_t size, size_t alignment) {
+  // The original pointer is kept right before the aligned block
+  char *raw = static_cast<char*>(::operator new(size+alignment+sizeof(void*)));
+  uintptr_t start = reinterpret_cast<uintptr_t>(raw+sizeof(void*));
+  start = (start+alignment-1) & ~uintptr_t(alignment-1);
+  char *result = reinterpret_cast<char*>(start);
+  reinterpret_cast<void**>(result)[-1] = raw;
+  return result;
+}
+
+void free_aligned(void *pointer) {
+  if (!pointer) return;
+  ::operator delete(static_cast<void**>(pointer)[-1]);
+}
+
+void* CacheAligned::operator new(size_t size) {
+  return allocate_aligned(size, cache_line);
+}
+
+void CacheAligned::operator delete(void *pointer) {
+  free_aligned(pointer);
+}
+
+}
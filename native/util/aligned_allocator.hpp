@@ -0,0 +1,47 @@
+#ifndef ALIGNED_ALLOCATOR_HPP
+#define ALIGNED_ALLOCATOR_HPP
+
+#include "common.hpp"
+#include <cstddef>
+
+namespace audionodes {
+
+// Memory aligned beyond what operator new guarantees before C++17,
+// alignment has to be a power of two
+void* allocate_aligned(size_t size, size_t alignment);
+void free_aligned(void*);
+
+// Standard allocator handing out cache line aligned memory, for
+// containers of over-aligned types such as Chunk
+template<typename T>
+class AlignedAllocator {
+  public:
+  typedef T value_type;
+  static const size_t alignment = alignof(T) > cache_line ? alignof(T) : cache_line;
+  template<typename U>
+  struct rebind {
+    typedef AlignedAllocator<U> other;
+  };
+  AlignedAllocator() {}
+  template<typename U>
+  AlignedAllocator(const AlignedAllocator<U>&) {}
+  T* allocate(size_t);
+  void deallocate(T*, size_t);
+};
+
+template<typename T, typename U>
+bool operator==(const AlignedAllocator<T>&, const AlignedAllocator<U>&) { return true; }
+template<typename T, typename U>
+bool operator!=(const AlignedAllocator<T>&, const AlignedAllocator<U>&) { return false; }
+
+// Base for heap allocated classes holding chunks
+struct CacheAligned {
+  static void* operator new(size_t);
+  static void operator delete(void*);
+};
+
+}
+
+#include "aligned_allocator.tpp"
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef ALIGNED_ALLOCATOR_TPP
+#define ALIGNED_ALLOCATOR_TPP
+
+#include <new>
+
+namespace audionodes {
+
+template<typename T>
+const size_t AlignedAllocator<T>::alignment;
+
+template<typename T>
+T* AlignedAllocator<T>::allocate(size_t n) {
+  return static_cast<T*>(allocate_aligned(n*sizeof(T), alignment));
+}
+
+template<typename T>
+void AlignedAllocator<T>::deallocate(T *pointer, size_t) {
+  free_aligned(pointer);
+}
+
+}
+
+#endif
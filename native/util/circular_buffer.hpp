@@ -19,6 +19,7 @@ class CircularBuffer {
   T pop();
   bool empty();
   bool full();
+  size_t size();
   
   // Use with caution: both threads have to agree on the clear synchronously
   void clear();
@@ -42,6 +42,12 @@ bool CircularBuffer<T, capacity>::full() {
     || (tmp_read_index == 0 && tmp_write_index == capacity-1);
 }
 
+template<typename T, size_t capacity>
+size_t CircularBuffer<T, capacity>::size() {
+  size_t tmp_read_index = read_index.load(), tmp_write_index = write_index.load();
+  return (tmp_write_index+capacity-tmp_read_index) % capacity;
+}
+
 template<typename T, size_t capacity>
 void CircularBuffer<T, capacity>::clear() {
   read_index = 0;
@@ -0,0 +1,390 @@
+#ifndef FAST_MATH_HPP
+#define FAST_MATH_HPP
+
+#include "common.hpp"
+#include "util/kernels.hpp"
+#include <cstring>
+#include <limits>
+
+namespace audionodes {
+
+// Approximations of libm functions evaluated in SIMD lanes (SSE2, one
+// lane elsewhere), after the Cephes single precision routines. Lanes the
+// approximation isn't meant for are recomputed with the libm function.
+// The bounds below were measured against double precision results, ulp
+// counts are relative to the exact result.
+namespace fast_math {
+
+#ifdef AUDIONODES_SSE2
+
+struct Mask {
+  __m128 v;
+};
+
+struct Ints {
+  __m128i v;
+};
+
+struct Lanes {
+  static const size_t width = 4;
+  __m128 v;
+  Lanes() {}
+  Lanes(__m128 v) : v(v) {}
+  Lanes(SigT value) : v(_mm_set1_ps(value)) {}
+  static Lanes load(const SigT *in) { return _mm_loadu_ps(in); }
+  void store(SigT *out) const { _mm_storeu_ps(out, v); }
+};
+
+inline Lanes operator+(Lanes a, Lanes b) { return _mm_add_ps(a.v, b.v); }
+inline Lanes operator-(Lanes a, Lanes b) { return _mm_sub_ps(a.v, b.v); }
+inline Lanes operator*(Lanes a, Lanes b) { return _mm_mul_ps(a.v, b.v); }
+inline Lanes operator/(Lanes a, Lanes b) { return _mm_div_ps(a.v, b.v); }
+inline Mask operator<(Lanes a, Lanes b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+inline Mask operator>(Lanes a, Lanes b) { return {_mm_cmpgt_ps(a.v, b.v)}; }
+inline Mask operator<=(Lanes a, Lanes b) { return {_mm_cmple_ps(a.v, b.v)}; }
+inline Mask operator>=(Lanes a, Lanes b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+inline Mask operator==(Lanes a, Lanes b) { return {_mm_cmpeq_ps(a.v, b.v)}; }
+inline Mask operator!=(Lanes a, Lanes b) { return {_mm_cmpneq_ps(a.v, b.v)}; }
+inline Mask operator&(Mask a, Mask b) { return {_mm_and_ps(a.v, b.v)}; }
+inline Mask operator|(Mask a, Mask b) { return {_mm_or_ps(a.v, b.v)}; }
+inline Mask operator~(Mask a) { return {_mm_xor_ps(a.v, _mm_castsi128_ps(_mm_set1_epi32(-1)))}; }
+inline bool any(Mask a) { return _mm_movemask_ps(a.v) != 0; }
+inline Lanes select(Mask mask, Lanes a, Lanes b) {
+  return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+}
+// Same NaN behaviour as std::min(a, b) and std::max(a, b)
+inline Lanes min(Lanes a, Lanes b) { return _mm_min_ps(b.v, a.v); }
+inline Lanes max(Lanes a, Lanes b) { return _mm_max_ps(b.v, a.v); }
+inline Lanes sqrt(Lanes a) { return _mm_sqrt_ps(a.v); }
+inline Lanes sign_bit(Lanes a) { return _mm_and_ps(a.v, _mm_set1_ps(-0.f)); }
+inline Lanes abs(Lanes a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a.v); }
+// a with the sign flipped where sign has its sign bit set
+inline Lanes flip_sign(Lanes a, Lanes sign) { return _mm_xor_ps(a.v, sign_bit(sign).v); }
+
+inline Ints operator+(Ints a, Ints b) { return {_mm_add_epi32(a.v, b.v)}; }
+inline Ints operator-(Ints a, Ints b) { return {_mm_sub_epi32(a.v, b.v)}; }
+inline Ints operator&(Ints a, Ints b) { return {_mm_and_si128(a.v, b.v)}; }
+inline Ints operator|(Ints a, Ints b) { return {_mm_or_si128(a.v, b.v)}; }
+inline Ints ints(int32_t value) { return {_mm_set1_epi32(value)}; }
+inline Ints shift_left(Ints a, int bits) { return {_mm_slli_epi32(a.v, bits)}; }
+inline Ints shift_right(Ints a, int bits) { return {_mm_srai_epi32(a.v, bits)}; }
+inline Mask nonzero(Ints a) { return {_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_cmpeq_epi32(a.v, _mm_setzero_si128()), _mm_setzero_si128()))}; }
+// Nearest integer (ties to even) and truncation, only for |a| < 2^31
+inline Ints round_to_int(Lanes a) { return {_mm_cvtps_epi32(a.v)}; }
+inline Ints truncate_to_int(Lanes a) { return {_mm_cvttps_epi32(a.v)}; }
+inline Lanes to_float(Ints a) { return _mm_cvtepi32_ps(a.v); }
+inline Ints bits(Lanes a) { return {_mm_castps_si128(a.v)}; }
+inline Lanes from_bits(Ints a) { return _mm_castsi128_ps(a.v); }
+
+#else
+
+struct Mask {
+  bool v;
+};
+
+struct Ints {
+  int32_t v;
+};
+
+struct Lanes {
+  static const size_t width = 1;
+  SigT v;
+  Lanes() {}
+  Lanes(SigT v) : v(v) {}
+  static Lanes load(const SigT *in) { return *in; }
+  void store(SigT *out) const { *out = v; }
+};
+
+inline Lanes operator+(Lanes a, Lanes b) { return a.v + b.v; }
+inline Lanes operator-(Lanes a, Lanes b) { return a.v - b.v; }
+inline Lanes operator*(Lanes a, Lanes b) { return a.v * b.v; }
+inline Lanes operator/(Lanes a, Lanes b) { return a.v / b.v; }
+inline Mask operator<(Lanes a, Lanes b) { return {a.v < b.v}; }
+inline Mask operator>(Lanes a, Lanes b) { return {a.v > b.v}; }
+inline Mask operator<=(Lanes a, Lanes b) { return {a.v <= b.v}; }
+inline Mask operator>=(Lanes a, Lanes b) { return {a.v >= b.v}; }
+inline Mask operator==(Lanes a, Lanes b) { return {a.v == b.v}; }
+inline Mask operator!=(Lanes a, Lanes b) { return {a.v != b.v}; }
+inline Mask operator&(Mask a, Mask b) { return {a.v && b.v}; }
+inline Mask operator|(Mask a, Mask b) { return {a.v || b.v}; }
+inline Mask operator~(Mask a) { return {!a.v}; }
+inline bool any(Mask a) { return a.v; }
+inline Lanes select(Mask mask, Lanes a, Lanes b) { return mask.v ? a : b; }
+inline Lanes min(Lanes a, Lanes b) { return std::min(a.v, b.v); }
+inline Lanes max(Lanes a, Lanes b) { return std::max(a.v, b.v); }
+inline Lanes sqrt(Lanes a) { return std::sqrt(a.v); }
+inline Lanes sign_bit(Lanes a) { return std::signbit(a.v) ? -0.f : 0.f; }
+inline Lanes abs(Lanes a) { return std::abs(a.v); }
+inline Lanes flip_sign(Lanes a, Lanes sign) { return std::signbit(sign.v) ? -a.v : a.v; }
+
+inline Ints operator+(Ints a, Ints b) { return {int32_t(uint32_t(a.v) + uint32_t(b.v))}; }
+inline Ints operator-(Ints a, Ints b) { return {int32_t(uint32_t(a.v) - uint32_t(b.v))}; }
+inline Ints operator&(Ints a, Ints b) { return {a.v & b.v}; }
+inline Ints operator|(Ints a, Ints b) { return {a.v | b.v}; }
+inline Ints ints(int32_t value) { return {value}; }
+inline Ints shift_left(Ints a, int bits) { return {int32_t(uint32_t(a.v) << bits)}; }
+inline Ints shift_right(Ints a, int bits) { return {a.v >> bits}; }
+inline Mask nonzero(Ints a) { return {a.v != 0}; }
+// Out of range gives the minimum like the SSE2 conversions
+inline Ints round_to_int(Lanes a) {
+  return {std::abs(a.v) < 2147483648.f ? int32_t(std::nearbyint(a.v)) : std::numeric_limits<int32_t>::min()};
+}
+inline Ints truncate_to_int(Lanes a) {
+  return {std::abs(a.v) < 2147483648.f ? int32_t(a.v) : std::numeric_limits<int32_t>::min()};
+}
+inline Lanes to_float(Ints a) { return SigT(a.v); }
+inline Ints bits(Lanes a) {
+  Ints result;
+  std::memcpy(&result.v, &a.v, sizeof(result.v));
+  return result;
+}
+inline Lanes from_bits(Ints a) {
+  Lanes result;
+  std::memcpy(&result.v, &a.v, sizeof(result.v));
+  return result;
+}
+
+#endif
+
+inline Mask is_finite(Lanes a) {
+  return abs(a) <= Lanes(std::numeric_limits<SigT>::max());
+}
+
+// Recomputes the lanes selected by mask with a scalar function of the
+// lanes of x and y
+template<typename F>
+inline Lanes recompute(Mask mask, Lanes result, Lanes x, Lanes y, F function) {
+  if (!any(mask)) return result;
+  SigT results[Lanes::width], xs[Lanes::width], ys[Lanes::width], use[Lanes::width];
+  result.store(results);
+  x.store(xs);
+  y.store(ys);
+  select(mask, Lanes(1), Lanes(0)).store(use);
+  for (size_t l = 0; l < Lanes::width; ++l) {
+    if (use[l] != 0) results[l] = function(xs[l], ys[l]);
+  }
+  return Lanes::load(results);
+}
+
+// Horner's scheme, coefficients from the highest order down
+inline Lanes horner(Lanes sum, Lanes) {
+  return sum;
+}
+template<typename... Rest>
+inline Lanes horner(Lanes sum, Lanes x, SigT c, Rest... rest) {
+  return horner(sum*x + Lanes(c), x, rest...);
+}
+template<typename... Rest>
+inline Lanes polynomial(Lanes x, SigT c, Rest... rest) {
+  return horner(Lanes(c), x, rest...);
+}
+
+// c1*x + c0, the terms of Estrin's scheme: where polynomials are
+// evaluated back to back (pow) its short dependency chains beat Horner's
+inline Lanes linear(Lanes x, SigT c1, SigT c0) {
+  return Lanes(c1)*x + Lanes(c0);
+}
+
+const SigT not_a_number = std::numeric_limits<SigT>::quiet_NaN();
+const SigT half_pi = M_PI/2;
+
+// Arguments of sin, cos and tan up to this size are reduced in float,
+// larger ones go to libm
+const SigT trig_range = 8192;
+
+// Multiple k of pi/2 nearest to x and the remainder, pi/2 being split in
+// three parts (Cody and Waite) so that the products with k are exact
+struct Reduced {
+  Lanes remainder;
+  Ints k;
+};
+inline Reduced reduce_half_pi(Lanes x) {
+  Ints k = round_to_int(x*Lanes(2/M_PI));
+  Lanes kf = to_float(k);
+  Lanes remainder = x - kf*Lanes(1.5703125f);
+  remainder = remainder - kf*Lanes(4.837512969970703125e-4f);
+  remainder = remainder - kf*Lanes(7.54978995489188216e-8f);
+  return {remainder, k};
+}
+
+// Absolute error at most 2^-23 (|x| <= trig_range)
+inline Lanes sin_cos(Lanes x, int quarter_turns) {
+  Reduced reduced = reduce_half_pi(x);
+  Lanes r = reduced.remainder, z = r*r;
+  Lanes sine = polynomial(z, -1.9515295891e-4f, 8.3321608736e-3f, -1.6666654611e-1f)*z*r + r;
+  Lanes cosine = polynomial(z, 2.443315711809948e-5f, -1.388731625493765e-3f, 4.166664568298827e-2f)*z*z
+    - Lanes(0.5f)*z + Lanes(1);
+  Ints quadrant = reduced.k + ints(quarter_turns);
+  Lanes result = select(nonzero(quadrant & ints(1)), cosine, sine);
+  return select(nonzero(quadrant & ints(2)), Lanes(0)-result, result);
+}
+inline Lanes sin(Lanes x) {
+  return recompute(~(abs(x) <= Lanes(trig_range)), sin_cos(x, 0), x, x,
+    [](SigT a, SigT) { return std::sin(a); });
+}
+inline Lanes cos(Lanes x) {
+  return recompute(~(abs(x) <= Lanes(trig_range)), sin_cos(x, 1), x, x,
+    [](SigT a, SigT) { return std::cos(a); });
+}
+
+// Relative error at most 3 ulp in (-pi/2, pi/2). Further out the reduced
+// argument is off by up to 2^-25, which tan amplifies by 1 + tan(x)^2.
+inline Lanes tan(Lanes x) {
+  Reduced reduced = reduce_half_pi(x);
+  Lanes r = reduced.remainder, z = r*r;
+  Lanes result = polynomial(z, 9.38540185543e-3f, 3.11992232697e-3f, 2.44301354525e-2f,
+    5.34112807005e-2f, 1.33387994085e-1f, 3.33331568548e-1f)*z*r + r;
+  result = select(nonzero(reduced.k & ints(1)), Lanes(-1)/result, result);
+  return recompute(~(abs(x) <= Lanes(trig_range)), result, x, x,
+    [](SigT a, SigT) { return std::tan(a); });
+}
+
+// Arcsine of |t| <= 0.5
+inline Lanes asin_polynomial(Lanes t) {
+  Lanes z = t*t;
+  return polynomial(z, 4.2163199048e-2f, 2.4181311049e-2f, 4.5470025998e-2f,
+    7.4953002686e-2f, 1.6666752422e-1f)*z*t + t;
+}
+
+// Relative error at most 3 ulp (asin) and 2 ulp (acos), NaN outside
+// [-1, 1]
+inline Lanes asin(Lanes x) {
+  Lanes a = abs(x);
+  Mask outer = a > Lanes(0.5f);
+  Lanes p = asin_polynomial(select(outer, sqrt((Lanes(1)-a)*Lanes(0.5f)), a));
+  return flip_sign(select(outer, Lanes(half_pi)-(p+p), p), x);
+}
+inline Lanes acos(Lanes x) {
+  Mask outer = abs(x) > Lanes(0.5f);
+  Lanes p = asin_polynomial(select(outer, sqrt((Lanes(1)-abs(x))*Lanes(0.5f)), x));
+  Lanes outer_result = select(x < Lanes(0), Lanes(M_PI)-(p+p), p+p);
+  return select(outer, outer_result, Lanes(half_pi)-p);
+}
+
+// Relative error at most 3 ulp
+inline Lanes atan(Lanes x) {
+  Lanes a = abs(x);
+  Mask above = a > Lanes(2.414213562373095f), middle = a > Lanes(0.4142135623730950f);
+  Lanes offset = select(above, Lanes(half_pi), select(middle, Lanes(M_PI/4), Lanes(0)));
+  Lanes t = select(above, Lanes(-1)/a, select(middle, (a-Lanes(1))/(a+Lanes(1)), a));
+  Lanes z = t*t;
+  Lanes result = polynomial(z, 8.05374449538e-2f, -1.38776856032e-1f,
+    1.99777106478e-1f, -3.33329491539e-1f)*z*t + t;
+  return flip_sign(offset + result, x);
+}
+
+inline Mask is_normal_positive(Lanes x) {
+  return (x >= Lanes(std::numeric_limits<SigT>::min())) & (x <= Lanes(std::numeric_limits<SigT>::max()));
+}
+
+// Natural logarithm of a positive normal number, relative error at most
+// 1 ulp
+inline Lanes log_normal(Lanes x) {
+  // Mantissa in [sqrt(1/2), sqrt(2)) and exponent
+  Ints b = bits(x);
+  Lanes m = from_bits((b & ints(0x7fffff)) | ints(0x3f800000));
+  Mask high = m > Lanes(1.41421356237f);
+  m = select(high, m*Lanes(0.5f), m);
+  Lanes e = to_float(shift_right(b, 23) - ints(127)) + select(high, Lanes(1), Lanes(0));
+  Lanes t = m - Lanes(1), z = t*t;
+  Lanes z2 = z*z;
+  Lanes y = linear(t, -2.4999993993e-1f, 3.3333331174e-1f)
+    + linear(t, -1.6668057665e-1f, 2.0000714765e-1f)*z
+    + (linear(t, -1.2420140846e-1f, 1.4249322787e-1f)
+      + linear(t, -1.1514610310e-1f, 1.1676998740e-1f)*z)*z2
+    + Lanes(7.0376836292e-2f)*(z2*z2);
+  y = y*(t*z);
+  y = y + e*Lanes(-2.12194440e-4f);
+  y = y - Lanes(0.5f)*z;
+  return t + y + e*Lanes(0.693359375f);
+}
+
+// log(a)/log(b), relative error at most 3 ulp. Lanes with an operand
+// that isn't a positive normal number go to std::log.
+inline Lanes log_ratio(Lanes a, Lanes b) {
+  Lanes result = log_normal(a)/log_normal(b);
+  return recompute(~(is_normal_positive(a) & is_normal_positive(b)), result, a, b,
+    [](SigT x, SigT y) { return std::log(x)/std::log(y); });
+}
+
+// Exponential of |x| <= 87, relative error at most 1.1 ulp
+inline Lanes exp_normal(Lanes x) {
+  Ints n = round_to_int(x*Lanes(1.44269504088896341f));
+  Lanes nf = to_float(n);
+  Lanes r = x - nf*Lanes(0.693359375f);
+  r = r - nf*Lanes(-2.12194440e-4f);
+  Lanes z = r*r;
+  Lanes result = (linear(r, 1.6666665459e-1f, 5.0000001201e-1f)
+    + linear(r, 8.3334519073e-3f, 4.1665795894e-2f)*z
+    + linear(r, 1.9875691500e-4f, 1.3981999507e-3f)*(z*z))*z + r + Lanes(1);
+  return result*from_bits(shift_left(n + ints(127), 23));
+}
+
+// exp(b*log|a|), so the relative error grows with the magnitude of the
+// logarithm of the result: at most (2 + 2|log(result)|) ulp. Zero,
+// subnormal and non-finite bases, and results beyond e^87 or below e^-87
+// go to std::pow.
+inline Lanes pow(Lanes a, Lanes b) {
+  Lanes magnitude = abs(a);
+  Lanes exponent = b*log_normal(magnitude);
+  Lanes result = exp_normal(exponent);
+  // Negative bases only have real powers with integer exponents. Floats
+  // from 2^23 on are even integers.
+  Mask large = ~(abs(b) < Lanes(8388608.f));
+  Ints integer_part = truncate_to_int(b);
+  Mask integer = large | (to_float(integer_part) == b);
+  Mask odd = ~large & nonzero(integer_part & ints(1));
+  Mask negative = a < Lanes(0);
+  result = select(negative & odd, Lanes(0)-result, result);
+  result = select(negative & ~integer, Lanes(not_a_number), result);
+  Mask usable = is_normal_positive(magnitude) & (abs(exponent) <= Lanes(87));
+  return recompute(~usable, result, a, b,
+    [](SigT x, SigT y) { return std::pow(x, y); });
+}
+
+// Exact, halfway cases away from zero like std::round
+inline Lanes round(Lanes x) {
+  Lanes truncated = to_float(truncate_to_int(x));
+  Lanes fraction = x - truncated;
+  Lanes rounded = truncated + select(abs(fraction) >= Lanes(0.5f), flip_sign(Lanes(1), x), Lanes(0));
+  // Keep the sign of zero results
+  rounded = from_bits(bits(rounded) | bits(sign_bit(x)));
+  // From 2^23 on every float is an integer, non-finite values pass as well
+  return select(abs(x) < Lanes(8388608.f), rounded, x);
+}
+
+// Splits x into two halves of 12 bits (Veltkamp), products of halves are
+// exact
+inline void split(Lanes x, Lanes &high, Lanes &low) {
+  Lanes scaled = x*Lanes(4097.f);
+  high = scaled - (scaled - x);
+  low = x - high;
+}
+
+// Exact: the remainder is representable and the product of b with the
+// truncated quotient is kept exact. Quotients from 2^22 on, zero and
+// non-finite operands go to std::fmod.
+inline Lanes fmod(Lanes a, Lanes b) {
+  Lanes quotient = a/b;
+  Mask usable = (abs(quotient) < Lanes(4194304.f)) & (abs(b) < Lanes(1e30f));
+  Lanes whole = to_float(truncate_to_int(quotient));
+  // a - whole*b with the product kept exact (Dekker), the subtraction of
+  // its rounded part is exact as well
+  Lanes product = whole*b, whole_high, whole_low, b_high, b_low;
+  split(whole, whole_high, whole_low);
+  split(b, b_high, b_low);
+  Lanes error = ((whole_high*b_high - product) + whole_high*b_low + whole_low*b_high) + whole_low*b_low;
+  Lanes result = (a - product) - error;
+  // The quotient may have been rounded up to the next integer
+  Mask overshoot = ((a > Lanes(0)) & (result < Lanes(0))) | ((a < Lanes(0)) & (result > Lanes(0)));
+  result = select(overshoot, result + flip_sign(abs(b), a), result);
+  result = select(result == Lanes(0), flip_sign(Lanes(0), a), result);
+  return recompute(~usable, result, a, b,
+    [](SigT x, SigT y) { return std::fmod(x, y); });
+}
+
+}
+
+}
+
+#endif
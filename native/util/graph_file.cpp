@@ -0,0 +1,119 @@
+#include "util/graph_file.hpp"
+
+#include <sstream>
+#include <iomanip>
+#include <map>
+
+namespace audionodes {
+
+static bool parse_hex(const std::string &text, std::vector<char> &result) {
+  if (text.size() % 2 != 0) return false;
+  result.clear();
+  result.reserve(text.size()/2);
+  for (size_t i = 0; i < text.size(); i += 2) {
+    int value = 0;
+    for (size_t j = i; j < i+2; ++j) {
+      char c = text[j];
+      int digit;
+      if (c >= '0' && c <= '9') digit = c-'0';
+      else if (c >= 'a' && c <= 'f') digit = c-'a'+10;
+      else if (c >= 'A' && c <= 'F') digit = c-'A'+10;
+      else return false;
+      value = value*16 + digit;
+    }
+    result.push_back(char(value));
+  }
+  return true;
+}
+
+bool GraphFile::read(std::istream &stream, std::string &error) {
+  std::map<std::string, size_t> node_index;
+  std::string line;
+  for (size_t line_number = 1; std::getline(stream, line); ++line_number) {
+    std::istringstream words(line);
+    std::string statement;
+    if (!(words >> statement) || statement[0] == '#') continue;
+    auto fail = [&](const std::string &reason) {
+      error = "line " + std::to_string(line_number) + ": " + reason;
+      return false;
+    };
+    auto find_node = [&](const std::string &name, size_t &index) {
+      auto found = node_index.find(name);
+      if (found == node_index.end()) return false;
+      index = found->second;
+      return true;
+    };
+    std::string name;
+    size_t index;
+    if (statement == "node") {
+      Node node;
+      if (!(words >> node.name >> node.type)) return fail("expected node <name> <type>");
+      if (node_index.count(node.name)) return fail("node " + node.name + " declared twice");
+      node_index[node.name] = nodes.size();
+      nodes.push_back(node);
+    } else if (statement == "input") {
+      size_t slot;
+      SigT value;
+      if (!(words >> name >> slot >> value)) return fail("expected input <name> <index> <value>");
+      if (!find_node(name, index)) return fail("unknown node " + name);
+      nodes[index].inputs.emplace_back(slot, value);
+    } else if (statement == "property") {
+      size_t slot;
+      int value;
+      if (!(words >> name >> slot >> value)) return fail("expected property <name> <index> <value>");
+      if (!find_node(name, index)) return fail("unknown node " + name);
+      nodes[index].properties.emplace_back(slot, value);
+    } else if (statement == "binary") {
+      int slot;
+      std::string hex;
+      std::vector<char> payload;
+      if (!(words >> name >> slot >> hex)) return fail("expected binary <name> <slot> <hex>");
+      if (!find_node(name, index)) return fail("unknown node " + name);
+      if (!parse_hex(hex, payload)) return fail("invalid hex payload");
+      nodes[index].binaries.emplace_back(slot, payload);
+    } else if (statement == "link") {
+      std::string from_name, to_name;
+      Link link;
+      if (!(words >> from_name >> link.from_socket >> to_name >> link.to_socket)) {
+        return fail("expected link <from> <socket> <to> <socket>");
+      }
+      if (!find_node(from_name, link.from_node)) return fail("unknown node " + from_name);
+      if (!find_node(to_name, link.to_node)) return fail("unknown node " + to_name);
+      links.push_back(link);
+    } else {
+      return fail("unknown statement " + statement);
+    }
+  }
+  return true;
+}
+
+void GraphFile::write(std::ostream &stream) const {
+  stream << "# Audionodes graph" << std::endl;
+  // Enough digits to read back the exact same float
+  stream << std::setprecision(9);
+  for (const Node &node : nodes) {
+    stream << "node " << node.name << " " << node.type << std::endl;
+    for (auto &input : node.inputs) {
+      stream << "input " << node.name << " " << input.first << " " << input.second << std::endl;
+    }
+    for (auto &property : node.properties) {
+      stream << "property " << node.name << " " << property.first << " " << property.second << std::endl;
+    }
+    for (auto &binary : node.binaries) {
+      if (binary.second.empty()) continue;
+      stream << "binary " << node.name << " " << binary.first << " ";
+      const char *digits = "0123456789abcdef";
+      for (char c : binary.second) {
+        unsigned char byte = c;
+        stream << digits[byte >> 4] << digits[byte & 0xF];
+      }
+      stream << std::endl;
+    }
+  }
+  for (const Link &link : links) {
+    stream << "link " << nodes[link.from_node].name << " " << link.from_socket
+      << " " << nodes[link.to_node].name << " " << link.to_socket << std::endl;
+  }
+}
+
+}
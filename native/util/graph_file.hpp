@@ -0,0 +1,41 @@
+
+#ifndef GRAPH_FILE_HPP
+#define GRAPH_FILE_HPP
+
+#include "common.hpp"
+#include <string>
+#include <istream>
+#include <ostream>
+
+namespace audionodes {
+
+// Description of a node graph as plain text, one statement per line:
+//   node <name> <type identifier>
+//   input <name> <index> <value>
+//   property <name> <index> <value>
+//   binary <name> <slot> <payload as hex>
+//   link <from name> <from socket> <to name> <to socket>
+// Nodes have to be declared before they are referred to,
+// empty lines and lines starting with # are ignored.
+struct GraphFile {
+  struct Node {
+    std::string name, type;
+    std::vector<std::pair<size_t, SigT>> inputs;
+    std::vector<std::pair<size_t, int>> properties;
+    std::vector<std::pair<int, std::vector<char>>> binaries;
+  };
+  struct Link {
+    size_t from_node, from_socket, to_node, to_socket;
+  };
+  std::vector<Node> nodes;
+  // Indices into nodes
+  std::vector<Link> links;
+  
+  // On failure, error describes the offending line
+  bool read(std::istream&, std::string &error);
+  void write(std::ostream&) const;
+};
+
+}
+
+#endif
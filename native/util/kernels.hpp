@@ -0,0 +1,176 @@
+#ifndef KERNELS_HPP
+#define KERNELS_HPP
+
+#include "common.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AUDIONODES_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace audionodes {
+
+// Basic per-block operations in SIMD (SSE2, scalar loops elsewhere) over
+// the engine block size, instantiated for each supported size (see
+// with_block_size). Each lane rounds exactly like the scalar expression it
+// replaces, so results don't depend on the instruction set. The binary
+// operations accept a length for chunks of which only a prefix is of
+// interest.
+namespace kernels {
+
+#ifdef AUDIONODES_SSE2
+const size_t width = 4;
+#endif
+
+inline void fill(Chunk &out, SigT value) {
+  with_block_size([&](auto n) {
+#ifdef AUDIONODES_SSE2
+    __m128 v = _mm_set1_ps(value);
+    for (size_t j = 0; j < n; j += width) _mm_storeu_ps(&out[j], v);
+#else
+    std::fill_n(out.begin(), n(), value);
+#endif
+  });
+}
+
+// Linear ramp reaching to at the end of the block (n samples):
+// out[j] = ((n-j-offset)*from + (j+offset)*to)/n, in float
+inline void ramp(Chunk &out, SigT from, SigT to, size_t offset = 0) {
+  with_block_size([&](auto n) {
+#ifdef AUDIONODES_SSE2
+    const __m128 total = _mm_set1_ps(n), step = _mm_set1_ps(width);
+    const __m128 a = _mm_set1_ps(from), b = _mm_set1_ps(to);
+    __m128 position = _mm_add_ps(_mm_set_ps(3, 2, 1, 0), _mm_set1_ps(offset));
+    for (size_t j = 0; j < n; j += width) {
+      __m128 rest = _mm_sub_ps(total, position);
+      __m128 mix = _mm_add_ps(_mm_mul_ps(rest, a), _mm_mul_ps(position, b));
+      _mm_storeu_ps(&out[j], _mm_div_ps(mix, total));
+      position = _mm_add_ps(position, step);
+    }
+#else
+    for (size_t j = 0; j < n; ++j) {
+      out[j] = ((SigT(n)-SigT(j+offset))*from + SigT(j+offset)*to)/n;
+    }
+#endif
+  });
+}
+
+// Length is a size_t or, for whole blocks, a std::integral_constant
+#ifdef AUDIONODES_SSE2
+#define KERNEL_BINARY(name, vector, scalar) \
+template<typename Length> \
+inline void name##_prefix(Chunk &out, const Chunk &in, Length length) { \
+  size_t j = 0, vector_end = length - length%width; \
+  for (; j < vector_end; j += width) { \
+    __m128 x = _mm_loadu_ps(&in[j]), y = _mm_loadu_ps(&out[j]); \
+    _mm_storeu_ps(&out[j], vector); \
+  } \
+  for (; j < length; ++j) { \
+    SigT x = in[j], y = out[j]; \
+    out[j] = scalar; \
+  } \
+} \
+KERNEL_BINARY_ENTRIES(name)
+#else
+#define KERNEL_BINARY(name, vector, scalar) \
+template<typename Length> \
+inline void name##_prefix(Chunk &out, const Chunk &in, Length length) { \
+  for (size_t j = 0; j < length; ++j) { \
+    SigT x = in[j], y = out[j]; \
+    out[j] = scalar; \
+  } \
+} \
+KERNEL_BINARY_ENTRIES(name)
+#endif
+#define KERNEL_BINARY_ENTRIES(name) \
+inline void name(Chunk &out, const Chunk &in) { \
+  with_block_size([&](auto n) { name##_prefix(out, in, n); }); \
+} \
+inline void name(Chunk &out, const Chunk &in, size_t length) { \
+  name##_prefix(out, in, length); \
+}
+
+// Accumulating operations, out = out op in. Reductions over voices run
+// these once per voice. The operand order of min and max keeps the
+// NaN behaviour of std::min(out, in) and std::max(out, in).
+KERNEL_BINARY(add, _mm_add_ps(y, x), y + x)
+KERNEL_BINARY(mul, _mm_mul_ps(y, x), y * x)
+KERNEL_BINARY(min, _mm_min_ps(x, y), std::min(y, x))
+KERNEL_BINARY(max, _mm_max_ps(x, y), std::max(y, x))
+
+#undef KERNEL_BINARY
+#undef KERNEL_BINARY_ENTRIES
+
+// out = out*factor + addend, rounded after the multiplication as well
+// (not fused)
+inline void mul_add(Chunk &out, const Chunk &factor, const Chunk &addend) {
+  with_block_size([&](auto n) {
+#ifdef AUDIONODES_SSE2
+    for (size_t j = 0; j < n; j += width) {
+      __m128 product = _mm_mul_ps(_mm_loadu_ps(&out[j]), _mm_loadu_ps(&factor[j]));
+      _mm_storeu_ps(&out[j], _mm_add_ps(product, _mm_loadu_ps(&addend[j])));
+    }
+#else
+    for (size_t j = 0; j < n; ++j) {
+      out[j] = out[j]*factor[j] + addend[j];
+    }
+#endif
+  });
+}
+
+// out = condition != 0 ? a : b
+inline void select(Chunk &out, const Chunk &condition, const Chunk &a, const Chunk &b) {
+  with_block_size([&](auto n) {
+#ifdef AUDIONODES_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    for (size_t j = 0; j < n; j += width) {
+      __m128 mask = _mm_cmpneq_ps(_mm_loadu_ps(&condition[j]), zero);
+      __m128 chosen = _mm_or_ps(
+        _mm_and_ps(mask, _mm_loadu_ps(&a[j])),
+        _mm_andnot_ps(mask, _mm_loadu_ps(&b[j])));
+      _mm_storeu_ps(&out[j], chosen);
+    }
+#else
+    for (size_t j = 0; j < n; ++j) {
+      out[j] = condition[j] != 0 ? a[j] : b[j];
+    }
+#endif
+  });
+}
+
+// Converts samples to 16-bit integers, clamping the ones outside [-1, 1)
+inline void clamp_to_int16(const SigT *in, int16_t *out, size_t count) {
+  const int16_t maximum_value = (1 << 15)-1, minimum_value = -(1 << 15);
+  size_t j = 0;
+#ifdef AUDIONODES_SSE2
+  const __m128 lower = _mm_set1_ps(-1), upper = _mm_set1_ps(1);
+  const __m128 scale = _mm_set1_ps(maximum_value);
+  auto convert = [&](size_t k) {
+    __m128 x = _mm_loadu_ps(in+k);
+    __m128 clamped = _mm_min_ps(_mm_max_ps(x, lower), upper);
+    __m128i result = _mm_cvttps_epi32(_mm_mul_ps(clamped, scale));
+    // Below -1 takes the extra step down to the minimum value
+    return _mm_add_epi32(result, _mm_castps_si128(_mm_cmplt_ps(x, lower)));
+  };
+  size_t vector_end = count - count%(2*width);
+  for (; j < vector_end; j += 2*width) {
+    __m128i packed = _mm_packs_epi32(convert(j), convert(j+width));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out+j), packed);
+  }
+#endif
+  for (; j < count; ++j) {
+    if (in[j] < -1) {
+      out[j] = minimum_value;
+    } else if (in[j] >= 1) {
+      out[j] = maximum_value;
+    } else {
+      out[j] = in[j] * maximum_value;
+    }
+  }
+}
+
+}
+
+}
+
+#endif
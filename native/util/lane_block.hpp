@@ -0,0 +1,36 @@
+
+#ifndef LANE_BLOCK_HPP
+#define LANE_BLOCK_HPP
+
+#include "common.hpp"
+
+namespace audionodes {
+
+// Block of up to L voices in voice-interleaved (structure of arrays)
+// layout: sample-major with the voices innermost, so that a recurrence
+// serial in time but independent across voices can advance the voices of
+// a sample together. The IIR filter runs its voices through it in double
+// precision, from per-voice chunks or from the interleaved groups of
+// AudioData::lanes (same layout in SigT). The lane loops are plain scalar
+// code left to the auto-vectorizer.
+template<typename T, size_t L>
+struct LaneBlock {
+  static constexpr size_t lanes = L;
+  alignas(64) T samples[N][L];
+  // Copy count (at most L) voices in, null voices and the remaining
+  // lanes are zeroed
+  void gather(const Chunk *const *voices, size_t count);
+  // Copy the first count lanes out
+  void scatter(Chunk *const *voices, size_t count) const;
+  // Copy an interleaved group of L voices in or out
+  void load(const SigT *group);
+  void store(SigT *group) const;
+  // Zero one lane
+  void clear(size_t lane);
+};
+
+}
+
+#include "lane_block.tpp"
+
+#endif
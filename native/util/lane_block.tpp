@@ -0,0 +1,63 @@
+#ifndef LANE_BLOCK_TPP
+#define LANE_BLOCK_TPP
+
+namespace audionodes {
+
+template<typename T, size_t L>
+constexpr size_t LaneBlock<T, L>::lanes;
+
+template<typename T, size_t L>
+void LaneBlock<T, L>::gather(const Chunk *const *voices, size_t count) {
+  for (size_t l = 0; l < count; ++l) {
+    if (!voices[l]) {
+      clear(l);
+      continue;
+    }
+    const Chunk &voice = *voices[l];
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+      samples[i][l] = voice[i];
+    }
+  }
+  for (size_t l = count; l < L; ++l) {
+    clear(l);
+  }
+}
+
+template<typename T, size_t L>
+void LaneBlock<T, L>::scatter(Chunk *const *voices, size_t count) const {
+  for (size_t l = 0; l < count; ++l) {
+    Chunk &voice = *voices[l];
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+      voice[i] = samples[i][l];
+    }
+  }
+}
+
+template<typename T, size_t L>
+void LaneBlock<T, L>::load(const SigT *group) {
+  for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+    for (size_t l = 0; l < L; ++l) {
+      samples[i][l] = group[i*L+l];
+    }
+  }
+}
+
+template<typename T, size_t L>
+void LaneBlock<T, L>::store(SigT *group) const {
+  for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+    for (size_t l = 0; l < L; ++l) {
+      group[i*L+l] = samples[i][l];
+    }
+  }
+}
+
+template<typename T, size_t L>
+void LaneBlock<T, L>::clear(size_t lane) {
+  for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+    samples[i][lane] = 0;
+  }
+}
+
+}
+
+#endif
@@ -0,0 +1,43 @@
+#include "util/pool_allocator.hpp"
+#include "util/aligned_allocator.hpp"
+
+namespace audionodes {
+
+void* PoolAllocator::allocate(size_t size) {
+  size_t size_class = (std::max(size, size_t(1))+granularity-1)/granularity;
+  if (size_class > class_amount) return allocate_aligned(size, granularity);
+  std::lock_guard<std::mutex> lock(mutex);
+  FreeEntry *&free_list = free_lists[size_class-1];
+  if (free_list) {
+    void *result = free_list;
+    free_list = free_list->next;
+    return result;
+  }
+  size_t rounded = size_class*granularity;
+  if (block_position == nullptr || size_t(block_end-block_position) < rounded) {
+    blocks.emplace_back(new char[block_size+granularity]);
+    // Align the start of the block
+    uintptr_t start = reinterpret_cast<uintptr_t>(blocks.back().get());
+    start = (start+granularity-1)/granularity*granularity;
+    block_position = reinterpret_cast<char*>(start);
+    block_end = block_position+block_size;
+  }
+  void *result = block_position;
+  block_position += rounded;
+  return result;
+}
+
+void PoolAllocator::deallocate(void *pointer, size_t size) {
+  if (!pointer) return;
+  size_t size_class = (std::max(size, size_t(1))+granularity-1)/granularity;
+  if (size_class > class_amount) {
+    free_aligned(pointer);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  FreeEntry *entry = static_cast<FreeEntry*>(pointer);
+  entry->next = free_lists[size_class-1];
+  free_lists[size_class-1] = entry;
+}
+
+}
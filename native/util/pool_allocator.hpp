@@ -0,0 +1,36 @@
+
+#ifndef POOL_ALLOCATOR_HPP
+#define POOL_ALLOCATOR_HPP
+
+#include "common.hpp"
+#include <memory>
+#include <mutex>
+
+namespace audionodes {
+
+// Places objects of varying sizes next to each other in large blocks.
+// Sizes are rounded up to size classes and freed memory is reused for
+// the same class; the blocks are only returned when the allocator is
+// destroyed. Larger objects are allocated separately.
+class PoolAllocator {
+  struct FreeEntry {
+    FreeEntry *next;
+  };
+  // Also the alignment of every allocation
+  static const size_t granularity = cache_line;
+  static const size_t class_amount = 128;
+  static const size_t block_size = 1 << 18;
+  FreeEntry *free_lists[class_amount] = {};
+  std::vector<std::unique_ptr<char[]>> blocks;
+  char *block_position = nullptr, *block_end = nullptr;
+  std::mutex mutex;
+  
+  public:
+  void* allocate(size_t);
+  // Has to be given the size used to allocate
+  void deallocate(void*, size_t);
+};
+
+}
+
+#endif
@@ -0,0 +1,60 @@
+
+#ifndef SLOT_MAP_HPP
+#define SLOT_MAP_HPP
+
+#include "common.hpp"
+
+namespace audionodes {
+
+// Values addressed by generational handles. A handle combines the slot
+// index with the generation the slot had when the value was inserted, so
+// lookups are O(1) and handles of erased values are recognized as stale
+// even after their slot has been reused. The generation has 11 bits: a
+// slot is retired once it runs out of generations rather than wrapping
+// around, so a handle is never issued twice.
+template<typename T>
+class SlotMap {
+  public:
+  // Fits node_uid, never negative for valid handles
+  typedef int Handle;
+  static const Handle invalid = -1;
+  
+  private:
+  static const int index_bits = 20;
+  static const uint32_t index_mask = (1u << index_bits)-1;
+  static const uint32_t generation_mask = (1u << (31-index_bits))-1;
+  struct Slot {
+    T value;
+    uint32_t generation = 0;
+    bool occupied = false;
+  };
+  std::vector<Slot> slots;
+  std::vector<uint32_t> free_slots;
+  size_t amount = 0;
+  Slot* get_slot(Handle);
+  
+  public:
+  // Returns invalid if all slots are in use or retired
+  Handle insert(T);
+  // nullptr if the handle is stale or invalid
+  T* find(Handle);
+  bool count(Handle);
+  // Only for handles known to be valid
+  T& operator[](Handle);
+  bool erase(Handle);
+  void clear();
+  size_t size() const;
+  // Call function(handle, value) for every value, in slot order
+  template<class F>
+  void for_each(F function) {
+    for (uint32_t i = 0; i < slots.size(); ++i) {
+      if (slots[i].occupied) function(Handle((slots[i].generation << index_bits) | i), slots[i].value);
+    }
+  }
+};
+
+}
+
+#include "slot_map.tpp"
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef SLOT_MAP_TPP
+#define SLOT_MAP_TPP
+
+namespace audionodes {
+
+template<typename T>
+typename SlotMap<T>::Slot* SlotMap<T>::get_slot(Handle handle) {
+  if (handle < 0) return nullptr;
+  uint32_t index = uint32_t(handle) & index_mask, generation = uint32_t(handle) >> index_bits;
+  if (index >= slots.size()) return nullptr;
+  Slot &slot = slots[index];
+  if (!slot.occupied || slot.generation != generation) return nullptr;
+  return &slot;
+}
+
+template<typename T>
+typename SlotMap<T>::Handle SlotMap<T>::insert(T value) {
+  uint32_t index;
+  if (!free_slots.empty()) {
+    index = free_slots.back();
+    free_slots.pop_back();
+  } else {
+    if (slots.size() > index_mask) return invalid;
+    index = slots.size();
+    slots.emplace_back();
+  }
+  Slot &slot = slots[index];
+  slot.value = std::move(value);
+  slot.occupied = true;
+  amount++;
+  return Handle((slot.generation << index_bits) | index);
+}
+
+template<typename T>
+T* SlotMap<T>::find(Handle handle) {
+  Slot *slot = get_slot(handle);
+  return slot ? &slot->value : nullptr;
+}
+
+template<typename T>
+bool SlotMap<T>::count(Handle handle) {
+  return get_slot(handle) != nullptr;
+}
+
+template<typename T>
+T& SlotMap<T>::operator[](Handle handle) {
+  return get_slot(handle)->value;
+}
+
+template<typename T>
+bool SlotMap<T>::erase(Handle handle) {
+  Slot *slot = get_slot(handle);
+  if (!slot) return false;
+  slot->value = T();
+  slot->occupied = false;
+  amount--;
+  // Invalidates all handles to the slot. Wrapping around would make old
+  // handles valid again, so the last generation retires the slot.
+  if (slot->generation == generation_mask) return true;
+  slot->generation++;
+  free_slots.push_back(uint32_t(handle) & index_mask);
+  return true;
+}
+
+template<typename T>
+void SlotMap<T>::clear() {
+  // Generations are kept, old handles stay stale
+  for (uint32_t i = 0; i < slots.size(); ++i) {
+    if (slots[i].occupied) erase(Handle((slots[i].generation << index_bits) | i));
+  }
+}
+
+template<typename T>
+size_t SlotMap<T>::size() const {
+  return amount;
+}
+
+}
+
+#endif
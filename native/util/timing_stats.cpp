@@ -0,0 +1,84 @@
+#include "timing_stats.hpp"
+
+namespace audionodes {
+
+size_t TimingStats::bucket_index(uint64_t value) {
+  if (value < 4) return value;
+  size_t octave = 2;
+  while (octave < 63 && (value >> (octave+1)) != 0) octave++;
+  // The two bits after the leading one select the bucket within the octave
+  size_t index = (octave-1)*4 + ((value >> (octave-2)) & 3);
+  return std::min(index, bucket_amount-1);
+}
+
+uint64_t TimingStats::bucket_start(size_t index) {
+  if (index < 4) return index;
+  size_t octave = index/4 + 1;
+  return uint64_t(4 + index%4) << (octave-2);
+}
+
+void TimingStats::clear() {
+  for (auto &bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+  count.store(0, std::memory_order_relaxed);
+  total.store(0, std::memory_order_relaxed);
+  minimum.store(UINT64_MAX, std::memory_order_relaxed);
+  maximum.store(0, std::memory_order_relaxed);
+  voices.store(0, std::memory_order_relaxed);
+}
+
+void TimingStats::record(uint64_t nanoseconds, size_t voice_amount) {
+  if (reset_requested.load(std::memory_order_relaxed)) {
+    clear();
+    reset_requested.store(false, std::memory_order_relaxed);
+  }
+  // Single writer: plain load/store pairs are enough
+  auto &bucket = buckets[bucket_index(nanoseconds)];
+  bucket.store(bucket.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+  total.store(total.load(std::memory_order_relaxed)+nanoseconds, std::memory_order_relaxed);
+  if (nanoseconds < minimum.load(std::memory_order_relaxed)) {
+    minimum.store(nanoseconds, std::memory_order_relaxed);
+  }
+  if (nanoseconds > maximum.load(std::memory_order_relaxed)) {
+    maximum.store(nanoseconds, std::memory_order_relaxed);
+  }
+  voices.store(voice_amount, std::memory_order_relaxed);
+  count.store(count.load(std::memory_order_relaxed)+1, std::memory_order_release);
+}
+
+TimingStats::Summary TimingStats::get_summary() const {
+  Summary summary = {0, 0, 0, 0, 0, 0};
+  if (reset_requested) return summary;
+  uint64_t amount = count.load(std::memory_order_acquire);
+  if (amount == 0) return summary;
+  // The fields may be from slightly different moments, which is fine
+  // for monitoring purposes
+  uint64_t max_ns = maximum.load(std::memory_order_relaxed);
+  summary.count = amount;
+  summary.min = minimum.load(std::memory_order_relaxed)/1000.;
+  summary.mean = double(total.load(std::memory_order_relaxed))/amount/1000.;
+  summary.max = max_ns/1000.;
+  summary.voices = voices.load(std::memory_order_relaxed);
+  // Upper bound of the bucket containing the 99th percentile
+  uint64_t threshold = amount - amount/100, seen = 0;
+  for (size_t i = 0; i < bucket_amount; ++i) {
+    seen += buckets[i].load(std::memory_order_relaxed);
+    if (seen >= threshold) {
+      uint64_t end = i+1 < bucket_amount ? bucket_start(i+1) : max_ns;
+      summary.p99 = std::min(end, max_ns)/1000.;
+      break;
+    }
+  }
+  return summary;
+}
+
+void TimingStats::reset() {
+  reset_requested = true;
+}
+
+TimingStats::TimingStats() :
+    reset_requested(false)
+{
+  clear();
+}
+
+}
@@ -0,0 +1,45 @@
+
+#ifndef TIMING_STATS_HPP
+#define TIMING_STATS_HPP
+
+#include "common.hpp"
+#include <atomic>
+#include <chrono>
+
+namespace audionodes {
+
+// Duration statistics of a repeated operation. Recorded by one thread at
+// a time (e.g. whichever thread processes a node), read and reset from
+// any thread without locking.
+class TimingStats {
+  public:
+  struct Summary {
+    size_t count;
+    // In microseconds
+    double min, mean, max, p99;
+    // Voices (channels) processed on the last recording
+    size_t voices;
+  };
+  
+  private:
+  // Logarithmic histogram with 4 buckets per power of two nanoseconds
+  static const size_t bucket_amount = 128;
+  std::atomic<uint32_t> buckets[bucket_amount];
+  std::atomic<uint64_t> count, total, minimum, maximum;
+  std::atomic<size_t> voices;
+  // Cleared by the recording thread, so reset never races with record
+  std::atomic<bool> reset_requested;
+  static size_t bucket_index(uint64_t);
+  static uint64_t bucket_start(size_t);
+  void clear();
+  
+  public:
+  void record(uint64_t nanoseconds, size_t voices);
+  Summary get_summary() const;
+  void reset();
+  TimingStats();
+};
+
+}
+
+#endif
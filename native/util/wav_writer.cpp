@@ -0,0 +1,69 @@
+#include "util/wav_writer.hpp"
+
+namespace audionodes {
+
+template<typename T>
+static void write_le(std::ofstream &file, T value) {
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    file.put(char((value >> (8*i)) & 0xFF));
+  }
+}
+
+WavWriter::WavWriter(const std::string &path, int rate) :
+    file(path, std::ios::binary | std::ios::trunc),
+    rate(rate)
+{
+  write_header();
+}
+
+WavWriter::~WavWriter() {
+  close();
+}
+
+void WavWriter::write_header() {
+  constexpr uint16_t format_ieee_float = 3, channels = 1, bits = 32;
+  uint32_t data_size = sample_count*sizeof(float);
+  file.write("RIFF", 4);
+  write_le<uint32_t>(file, 50+data_size);
+  file.write("WAVE", 4);
+  // Formats other than PCM have the extension size field and a fact chunk
+  file.write("fmt ", 4);
+  write_le<uint32_t>(file, 18);
+  write_le<uint16_t>(file, format_ieee_float);
+  write_le<uint16_t>(file, channels);
+  write_le<uint32_t>(file, rate);
+  write_le<uint32_t>(file, rate*channels*bits/8);
+  write_le<uint16_t>(file, channels*bits/8);
+  write_le<uint16_t>(file, bits);
+  write_le<uint16_t>(file, 0);
+  file.write("fact", 4);
+  write_le<uint32_t>(file, 4);
+  write_le<uint32_t>(file, sample_count);
+  file.write("data", 4);
+  write_le<uint32_t>(file, data_size);
+}
+
+bool WavWriter::good() {
+  return file.is_open() && file.good();
+}
+
+void WavWriter::write(const SigT *samples, size_t amount) {
+  for (size_t i = 0; i < amount; ++i) {
+    float sample = samples[i];
+    uint32_t bits;
+    static_assert(sizeof(bits) == sizeof(sample), "32-bit float required");
+    std::memcpy(&bits, &sample, sizeof(bits));
+    write_le<uint32_t>(file, bits);
+  }
+  sample_count += amount;
+}
+
+bool WavWriter::close() {
+  if (!file.is_open()) return false;
+  file.seekp(0);
+  write_header();
+  file.close();
+  return !file.fail();
+}
+
+}
@@ -0,0 +1,31 @@
+
+#ifndef WAV_WRITER_HPP
+#define WAV_WRITER_HPP
+
+#include "common.hpp"
+#include <fstream>
+#include <string>
+#include <cstring>
+
+namespace audionodes {
+
+// Streams mono 32-bit float samples into a RIFF/WAVE file,
+// the header sizes and the sample count are patched in when the file is
+// closed
+class WavWriter {
+  std::ofstream file;
+  uint32_t sample_count = 0;
+  int rate;
+  void write_header();
+  public:
+  WavWriter(const std::string&, int rate);
+  ~WavWriter();
+  bool good();
+  void write(const SigT*, size_t);
+  // Returns false if writing failed at any point
+  bool close();
+};
+
+}
+
+#endif
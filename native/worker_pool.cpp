@@ -0,0 +1,127 @@
+#include "worker_pool.hpp"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace audionodes {
+
+thread_local size_t WorkerPool::thread_index = 0;
+
+void WorkerPool::Queue::acquire() {
+  while (lock.test_and_set(std::memory_order_acquire));
+}
+
+void WorkerPool::Queue::release() {
+  lock.clear(std::memory_order_release);
+}
+
+bool WorkerPool::Queue::push(Task task) {
+  acquire();
+  bool success = tail-head < capacity;
+  if (success) {
+    tasks[tail % capacity] = task;
+    tail++;
+  }
+  release();
+  return success;
+}
+
+bool WorkerPool::Queue::pop(Task &task) {
+  acquire();
+  bool success = tail != head;
+  if (success) {
+    tail--;
+    task = tasks[tail % capacity];
+  }
+  release();
+  return success;
+}
+
+bool WorkerPool::Queue::steal(Task &task) {
+  acquire();
+  bool success = tail != head;
+  if (success) {
+    task = tasks[head % capacity];
+    head++;
+  }
+  release();
+  return success;
+}
+
+void WorkerPool::push(Task task) {
+  if (!queues[thread_index].push(task)) {
+    task.function(task.context, task.index);
+  }
+}
+
+bool WorkerPool::try_run_one(size_t index) {
+  Task task;
+  bool found = queues[index].pop(task);
+  for (size_t i = 1; !found && i < queue_amount; ++i) {
+    found = queues[(index+i) % queue_amount].steal(task);
+  }
+  if (found) task.function(task.context, task.index);
+  return found;
+}
+
+void WorkerPool::worker_main(size_t index) {
+  thread_index = index;
+  while (running) {
+    if (active == 0) {
+      // The submitting thread notifies without holding the mutex (it must
+      // never block), so a wakeup may be missed -> poll with a timeout
+      std::unique_lock<std::mutex> lock(sleep_mutex);
+      sleep_cv.wait_for(lock, std::chrono::milliseconds(1));
+      continue;
+    }
+    if (!try_run_one(index)) std::this_thread::yield();
+  }
+}
+
+size_t WorkerPool::get_thread_amount() const {
+  return threads.size();
+}
+
+void WorkerPool::set_min_parallel_voices(size_t amount) {
+  min_parallel_voices = amount;
+}
+
+bool WorkerPool::should_split_voices(size_t voices) const {
+  size_t minimum = min_parallel_voices;
+  return minimum > 0 && voices >= minimum && !threads.empty();
+}
+
+WorkerPool::WorkerPool(size_t thread_amount) :
+    queues(new Queue[thread_amount+1]),
+    queue_amount(thread_amount+1),
+    running(true),
+    active(0),
+    min_parallel_voices(0)
+{
+  threads.reserve(thread_amount);
+  for (size_t i = 1; i <= thread_amount; ++i) {
+    threads.emplace_back(&WorkerPool::worker_main, this, i);
+#ifdef __linux__
+    // Pin workers to separate cores, the submitting thread is left alone
+    unsigned cores = std::thread::hardware_concurrency();
+    if (cores > 1) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(i % cores, &set);
+      pthread_setaffinity_np(threads.back().native_handle(), sizeof(set), &set);
+    }
+#endif
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  running = false;
+  sleep_cv.notify_all();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+}
@@ -0,0 +1,107 @@
+
+#ifndef WORKER_POOL_HPP
+#define WORKER_POOL_HPP
+
+#include "common.hpp"
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+
+namespace audionodes {
+
+// Pool of worker threads executing small tasks with work stealing.
+// Every thread owns a queue it pushes to and pops from (LIFO, cache-warm),
+// idle threads steal from the other end of the other queues (FIFO).
+// The thread submitting work (e.g. the audio thread) always takes part via
+// run_until, so progress never depends on the workers being scheduled in time.
+class WorkerPool {
+  public:
+  typedef void (*TaskFunction)(void*, size_t);
+  struct Task {
+    TaskFunction function;
+    void *context;
+    size_t index;
+  };
+  
+  private:
+  class Queue {
+    static const size_t capacity = 1024;
+    Task tasks[capacity];
+    size_t head = 0, tail = 0;
+    std::atomic_flag lock = ATOMIC_FLAG_INIT;
+    void acquire();
+    void release();
+    public:
+    bool push(Task);
+    bool pop(Task&);
+    bool steal(Task&);
+  };
+  // Index 0 belongs to the submitting thread, the rest to workers
+  std::unique_ptr<Queue[]> queues;
+  size_t queue_amount;
+  std::vector<std::thread> threads;
+  std::atomic<bool> running;
+  // Amount of run_until calls in progress, workers sleep while zero
+  std::atomic<size_t> active;
+  std::mutex sleep_mutex;
+  std::condition_variable sleep_cv;
+  static thread_local size_t thread_index;
+  // Polyphonic nodes split their voices across the pool from this many
+  // voices onwards, zero disables per-voice parallelism
+  std::atomic<size_t> min_parallel_voices;
+  
+  void worker_main(size_t);
+  bool try_run_one(size_t);
+  
+  template<class F>
+  struct ForContext {
+    F &function;
+    std::atomic<size_t> remaining;
+  };
+  template<class F>
+  static void for_task(void *context_ptr, size_t index) {
+    ForContext<F> &context = *static_cast<ForContext<F>*>(context_ptr);
+    context.function(index);
+    context.remaining--;
+  }
+  
+  public:
+  // Queue a task, executed inline if the queue is full
+  void push(Task);
+  // Execute tasks on the calling thread until done() returns true
+  template<class F>
+  void run_until(F done) {
+    size_t index = thread_index;
+    active++;
+    sleep_cv.notify_all();
+    while (!done()) {
+      if (!try_run_one(index)) std::this_thread::yield();
+    }
+    active--;
+  }
+  // Call function(i) for i in [0, amount) across the pool, returns when all
+  // calls have finished (the calling thread helps in the meantime)
+  template<class F>
+  void parallel_for(size_t amount, F function) {
+    if (amount == 0) return;
+    ForContext<F> context{function, {amount}};
+    for (size_t i = 1; i < amount; ++i) {
+      push({for_task<F>, &context, i});
+    }
+    for_task<F>(&context, 0);
+    run_until([&context]() { return context.remaining == 0; });
+  }
+  size_t get_thread_amount() const;
+  void set_min_parallel_voices(size_t);
+  bool should_split_voices(size_t) const;
+  
+  // Spawns the given amount of worker threads (in addition to the caller)
+  WorkerPool(size_t);
+  ~WorkerPool();
+};
+
+}
+
+#endif